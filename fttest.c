@@ -0,0 +1,98 @@
+/*
+ * FEATURE TEST FOR LEAKED.H (runtests builds it once per option and checks
+ * what it reports)
+ */
+
+#define LEAKED_IMPLEMENTATION
+#include "leaked.h"
+
+#ifdef LEAKED_REACHABILITY
+static void* kept; // still reachable
+#endif
+
+#ifdef LEAKED_CONTEXTS
+static void over_budget(uint64_t ctx, size_t live_bytes, void* arg)
+{
+	(void)arg;
+	fprintf(stderr,
+			"context %lu over budget at %lu bytes\n",
+			(unsigned long)ctx,
+			(unsigned long)live_bytes);
+}
+#endif
+
+// allocate in frames of their own, so no stale copy of the pointers is
+// left where the reachability scan would find it
+static void __attribute__((noinline)) lose(void)
+{
+	void* volatile a = malloc(128); // leaked
+	(void)a;
+#ifdef LEAKED_REACHABILITY
+	void** list = (void**)malloc(2 * sizeof(void*)); // leak root
+	list[0] = malloc(300);							 // indirect leak
+	list[1] = malloc(400);							 // indirect leak
+#endif
+}
+
+static void __attribute__((noinline)) scrub(void)
+{
+	volatile char pad[4096];
+	for (size_t i = 0; i < sizeof(pad); i++) pad[i] = 0;
+}
+
+int main(void)
+{
+	leaked_init();
+
+	free(malloc(64));
+	lose();
+	scrub();
+
+#ifdef LEAKED_REDZONE
+	char* volatile rz = (char*)malloc(10);
+	rz[10] = 'x'; // one past the end
+	free(rz);
+#endif
+#ifdef LEAKED_QUARANTINE
+	char* volatile uaf = (char*)malloc(32);
+	free(uaf);
+	uaf[5] = 'x'; // caught when the quarantine drains at exit
+#endif
+#ifdef LEAKED_GUARD_PAGES
+	char* volatile gp = (char*)malloc(LEAKED_GUARD_PAGES + 1);
+	gp[LEAKED_GUARD_PAGES + 1] = 'x'; // short of the guard page, in the slack
+	free(gp);
+#endif
+#ifdef LEAKED_REACHABILITY
+	kept = malloc(100);
+#endif
+#ifdef LEAKED_TAGS
+	leaked_tag_push("cache");
+	void* volatile t = malloc(500); // leaked under "cache"
+	(void)t;
+	leaked_tag_pop();
+#endif
+#ifdef LEAKED_CONTEXTS
+	leaked_set_budget(1000, over_budget, NULL);
+	leaked_set_context(7);
+	free(malloc(2000));
+	leaked_set_context(0);
+	leaked_context_end(7);
+#endif
+#ifdef LEAKED_QUOTA
+	leaked_set_quota(NULL, 1 << 20, LEAKED_QUOTA_LOG | LEAKED_QUOTA_FAIL);
+	void* q = malloc(2 << 20);
+	if (!q) fprintf(stderr, "quota refused %d bytes\n", 2 << 20);
+	free(q);
+#endif
+#ifdef LEAKED_PEAK_TOP
+	void* pk[100];
+	for (int i = 0; i < 100; i++) pk[i] = malloc(1000);
+	for (int i = 0; i < 100; i++) free(pk[i]);
+#endif
+#ifdef LEAKED_SLACK
+	for (int i = 0; i < 10; i++) free(malloc(1));
+#endif
+
+	return 0;
+}
@@ -34,10 +34,102 @@
  *     - minimal overhead, intended for debugging only
  *     - enable thread-safety with: #define LEAKED_THREAD_SAFE
  *     - disable colors with: #define LEAKED_NO_COLOR
+ *     - pad blocks with checked redzones: #define LEAKED_REDZONE 16
+ *       (bytes per side, rounded up to 16; verified on free and at exit)
+ *     - hold freed blocks poisoned in a per-thread quarantine to catch
+ *       writes after free: #define LEAKED_QUARANTINE (1 << 20) (bytes)
+ *     - fill new blocks with junk / scrub freed ones:
+ *       #define LEAKED_ALLOC_FILL 0xcd, #define LEAKED_FREE_FILL 0xdd
+ *       or at runtime with leaked_set_fill(0xcd, 0xdd, cap), -1 turns a
+ *       fill off. at most `cap` bytes of a block are touched
+ *     - serve blocks of at least N bytes from their own mapping with a
+ *       PROT_NONE page right after them: #define LEAKED_GUARD_PAGES 65536
+ *       (#define LEAKED_GUARD_BEFORE to put the guard page in front). blocks
+ *       are 16-aligned, the slack between their end and the guard page is
+ *       filled and checked on free; #define LEAKED_GUARD_ALIGN 1 ends them
+ *       right at the page so the first byte past faults at once
+ *     - look up the block owning any interior address with
+ *       leaked_find(addr, &blk): #define LEAKED_ADDR_INDEX
+ *     - keep a bit per 16-byte granule of live block starts, so
+ *       leaked_owns(p) and invalid frees skip the table: #define LEAKED_SHADOW
+ *     - split leaks into definitely lost / indirectly lost / still
+ *       reachable with a conservative scan of data, bss, the stack and
+ *       leaked_register_root() ranges: #define LEAKED_REACHABILITY
+ *     - report only the roots of leaked object graphs, with the bytes
+ *       hanging off each one: #define LEAKED_LEAK_ROOTS
+ *     - record the call stack of every allocation (deduplicated, 4 bytes
+ *       per block): #define LEAKED_STACK_DEPTH 16, change the depth at
+ *       runtime with leaked_set_stack_depth(n). frames are walked through
+ *       frame pointers (build with -fno-omit-frame-pointer) without leaving
+ *       the thread's stack, or with backtrace(3) when the stack can't be
+ *       found or LEAKED_UNWIND_BACKTRACE is defined
+ *     - reports with raw addresses also dump the executable mappings,
+ *       symbolize them afterwards with tools/leaked-symbolize.c:
+ *       ./program 2> report.txt; leaked-symbolize < report.txt
+ *     - record the caller's return address instead of __FILE__/__LINE__,
+ *       sites are printed raw and resolved offline: #define LEAKED_RETADDR
+ *     - stream every malloc/free/realloc into a compact binary trace:
+ *       #define LEAKED_TRACE "leaked.trace". threads still running at exit
+ *       lose the events they haven't flushed yet
+ *     - embed a snapshot of the live heap in the trace every N ms, so
+ *       tools/leaked-analyze.c -t SECONDS can rebuild the heap at any
+ *       point without replaying from the start:
+ *       #define LEAKED_TRACE_CHECKPOINT 100
+ *     - keep allocation totals per site (and stack) and write them as a
+ *       pprof heap profile at exit: #define LEAKED_PPROF "heap.pb", or at
+ *       any point with leaked_write_pprof(path) (#define LEAKED_SITE_STATS
+ *       alone keeps the totals). read it with: go tool pprof prog heap.pb
+ *     - write folded stacks of live bytes, allocated bytes and allocation
+ *       counts for flame graphs: #define LEAKED_FOLDED "heap" (writes
+ *       heap.inuse.folded, heap.alloc.folded and heap.count.folded at
+ *       exit), or at any point with
+ *       leaked_write_folded(path, LEAKED_FOLD_INUSE). name raw frames with
+ *       leaked-symbolize -f heap.inuse.folded
+ *     - machine-readable reports of stats, a size histogram, per-site
+ *       totals and every leaked block: #define LEAKED_JSON "leaks.json",
+ *       #define LEAKED_CSV "leaks.csv" (at exit), or at any point with
+ *       leaked_write_report(path, LEAKED_FMT_JSON or LEAKED_FMT_CSV)
+ *     - compare a report against a baseline one with tools/leaked-diff.c,
+ *       it fails when a site leaks or peaks more than -p percent (and
+ *       -b bytes) over the baseline: leaked-diff base.json leaks.json
+ *     - leave known leaks out of reports with a suppression file read by
+ *       leaked_init: #define LEAKED_SUPPRESS "leaked.supp", one rule per
+ *       line: "file GLOB", "func GLOB" or "stack GLOB" (functions need
+ *       LEAKED_RETADDR or LEAKED_STACK_DEPTH), or leaked_suppress(rule)
+ *     - label allocations by subsystem: #define LEAKED_TAGS, then
+ *       leaked_tag_push("cache") / leaked_tag_pop() around the code (per
+ *       thread, realloc keeps a block's tag) or leaked_tag_block(p, "cache").
+ *       leaked_tag_bytes("cache", NULL) is what the tag holds now, leaks
+ *       and reports are split by tag
+ *     - account live / peak bytes per request: #define LEAKED_CONTEXTS,
+ *       leaked_set_context(id) on the thread serving it,
+ *       leaked_context_bytes(id, &peak) to ask, leaked_context_end(id)
+ *       when it's done. leaked_set_budget(bytes, fn, arg) calls
+ *       fn(id, live_bytes, arg) on the allocating thread whenever a
+ *       context goes over `bytes`
+ *     - soft byte limits checked at allocation time: #define LEAKED_QUOTA,
+ *       then leaked_set_quota(NULL, bytes, action) for the whole heap or
+ *       leaked_set_quota("cache", bytes, action) for a tag. action is
+ *       LEAKED_QUOTA_LOG (once), LEAKED_QUOTA_FAIL (malloc returns NULL)
+ *       and/or LEAKED_QUOTA_CALL (the leaked_set_quota_handler fn)
+ *     - per-site and global high-water marks of live blocks and bytes are
+ *       kept with the site totals (leaked_peak(&blocks), "peak_*" in
+ *       reports). #define LEAKED_PEAK_TOP 10 also keeps the 10 biggest
+ *       sites as the heap peaks, taken again every LEAKED_PEAK_STEP
+ *       percent of growth (default 10, and at least LEAKED_PEAK_MIN
+ *       bytes, default 4096), and prints them at exit
+ *     - slack, the usable size malloc_usable_size() reports past the
+ *       size asked for, per block and site: #define LEAKED_SLACK. the
+ *       sites losing the most to it are printed at exit, leaked_slack(&total)
+ *       is the live slack. without malloc_usable_size (or with redzones
+ *       or guard pages) it is estimated from glibc's size classes
  *
  */
 
 #define _POSIX_C_SOURCE 200809L
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
 
 #ifndef LEAKED_H
 #define LEAKED_H 1
@@ -46,6 +138,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef LEAKED_NO_COLOR
 #define YEL "\033[33m"
@@ -55,21 +148,209 @@
 #define RESET ""
 #endif
 
+#if defined(LEAKED_LEAK_ROOTS) && !defined(LEAKED_REACHABILITY)
+#define LEAKED_REACHABILITY 1
+#endif
+
+#ifdef LEAKED_REACHABILITY
+#include <setjmp.h>
+#ifndef LEAKED_ADDR_INDEX
+#define LEAKED_ADDR_INDEX 1
+#endif
+#ifndef LEAKED_SCAN_THREADS
+#define LEAKED_SCAN_THREADS 4
+#endif
+#ifndef LEAKED_MAX_ROOTS
+#define LEAKED_MAX_ROOTS 64
+#endif
+#endif
+
+#ifdef LEAKED_STACK_DEPTH
+#include <execinfo.h>
+#define LEAKED_DEPOT_BUCKETS ((size_t)1 << 16)
+#define LEAKED_DEPOT_PAGE ((size_t)1 << 12)
+#define LEAKED_DEPOT_PAGES ((size_t)1 << 10) /* up to 4M unique stacks */
+#endif
+
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+/* keep the wrappers as real frames, so the unwinder can skip them and
+ * their return address is the user's call site */
+#define LEAKED_NOINLINE __attribute__((noinline))
+#else
+#define LEAKED_NOINLINE
+#endif
+
+#if defined(LEAKED_GUARD_PAGES) || defined(LEAKED_SHADOW)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(LEAKED_PPROF) || defined(LEAKED_FOLDED) || \
+  defined(LEAKED_JSON) || defined(LEAKED_CSV) || defined(LEAKED_SUPPRESS) || \
+  defined(LEAKED_PEAK_TOP) || defined(LEAKED_SLACK)
+#ifndef LEAKED_SITE_STATS
+#define LEAKED_SITE_STATS 1
+#endif
+#endif
+
+#if defined(LEAKED_PEAK_TOP) && !defined(LEAKED_PEAK_STEP)
+#define LEAKED_PEAK_STEP 10 /* percent of growth between snapshots */
+#endif
+#if defined(LEAKED_PEAK_TOP) && !defined(LEAKED_PEAK_MIN)
+#define LEAKED_PEAK_MIN 4096 /* fewest bytes of growth between snapshots */
+#endif
+
+#ifdef LEAKED_SITE_STATS
+#include <time.h>
+#endif
+
+#ifdef LEAKED_SUPPRESS
+#include <fnmatch.h>
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+#include <execinfo.h>
+#endif
+#endif
+
+#ifdef LEAKED_TRACE
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #ifdef LEAKED_THREAD_SAFE
 #include <pthread.h>
+#define LEAKED_TLS __thread
+#else
+#define LEAKED_TLS
+#endif
+
+/* frame walks and the reachability scan ask where a thread's stack is */
+#if (defined(LEAKED_STACK_DEPTH) && !defined(LEAKED_UNWIND_BACKTRACE)) || \
+  (defined(LEAKED_REACHABILITY) && defined(LEAKED_THREAD_SAFE))
+#include <pthread.h>
+#define LEAKED_STACK_BOUNDS 1
 #endif
 
 #define LEAKED_INITIAL_CAP 1024
 #define LEAKED_LOAD_NUM 3
 #define LEAKED_LOAD_DEN 4
 
+#ifdef LEAKED_REDZONE
+#define LEAKED_RZ ((((size_t)(LEAKED_REDZONE)) + 15) & ~(size_t)15)
+#ifndef LEAKED_REDZONE_BYTE
+#define LEAKED_REDZONE_BYTE 0xab
+#endif
+#ifndef LEAKED_SCAN_THREADS
+#define LEAKED_SCAN_THREADS 4
+#endif
+#else
+#define LEAKED_RZ ((size_t)0)
+#endif
+
+#ifndef LEAKED_FREE_BYTE
+#define LEAKED_FREE_BYTE 0xdd
+#endif
+
+#ifndef LEAKED_ALLOC_FILL
+#define LEAKED_ALLOC_FILL -1
+#endif
+#ifndef LEAKED_FREE_FILL
+#define LEAKED_FREE_FILL -1
+#endif
+#ifndef LEAKED_FILL_CAP
+#define LEAKED_FILL_CAP ((size_t)16 << 20)
+#endif
+/* fills at least this big bypass the cache */
+#ifndef LEAKED_NT_THRESHOLD
+#define LEAKED_NT_THRESHOLD ((size_t)256 << 10)
+#endif
+
+#ifdef LEAKED_GUARD_PAGES
+#ifndef LEAKED_GUARD_CACHE
+#define LEAKED_GUARD_CACHE 16
+#endif
+#ifndef LEAKED_GUARD_ALIGN
+#define LEAKED_GUARD_ALIGN 16 /* power of two, 1 = end right at the guard */
+#endif
+#ifndef LEAKED_REDZONE_BYTE
+#define LEAKED_REDZONE_BYTE 0xab
+#endif
+#define LEAKED_GUARDED(n) ((n) >= (size_t)(LEAKED_GUARD_PAGES))
+#else
+#define LEAKED_GUARDED(n) 0
+#endif
+
+/* freed blocks that can't go straight back to libc, realloc has to
+ * malloc/copy/free instead */
+#if defined(LEAKED_REDZONE) || defined(LEAKED_QUARANTINE) || \
+  defined(LEAKED_GUARD_PAGES)
+#define LEAKED_SLOW_FREE 1
+#endif
+
+/* where a block was allocated or freed. LEAKED_RETADDR keeps only the
+ * caller's return address and leaves file:line to the symbolizer */
+typedef struct
+{
+#ifdef LEAKED_RETADDR
+	const void* pc;
+#else
+	const char* file;
+	int line;
+#endif
+} Site;
+
+#ifdef LEAKED_RETADDR
+#define SITE_FMT "%p"
+#define SITE_ARG(s) (s).pc
+#define SITE_PARAMS
+#define SITE_HERE { __builtin_return_address(0) }
+#else
+#define SITE_FMT "%s:%d"
+#define SITE_ARG(s) (s).file, (s).line
+#define SITE_PARAMS , const char* f, int l
+#define SITE_HERE { f, l }
+#endif
+
+#if defined(LEAKED_TRACE) || defined(LEAKED_SITE_STATS)
+static int _site_eq(Site a, Site b)
+{
+#ifdef LEAKED_RETADDR
+	return a.pc == b.pc;
+#else
+	return a.file == b.file && a.line == b.line;
+#endif
+}
+#endif
+
 typedef struct Blk
 {
 	void* ptr;
 	size_t sz;
-	const char* file;
-	int line;
+	Site at; /* allocated at */
 	struct Blk* next;
+#ifdef LEAKED_ADDR_INDEX
+	struct Blk* left; /* address-ordered treap */
+	struct Blk* right;
+#endif
+#ifdef LEAKED_REACHABILITY
+	unsigned char mark; /* LEAKED_LOST, LEAKED_REACHED, LEAKED_INDIRECT */
+#endif
+#ifdef LEAKED_STACK_DEPTH
+	uint32_t stack; /* stack depot id, 0 = none */
+#endif
+#ifdef LEAKED_SITE_STATS
+	uint32_t stat; /* SiteStat id, 0 = none */
+#endif
+#ifdef LEAKED_SLACK
+	uint32_t slack; /* usable size - sz */
+#endif
+#ifdef LEAKED_TAGS
+	uint16_t tag; /* 0 = untagged */
+#endif
+#ifdef LEAKED_CONTEXTS
+	uint64_t ctx; /* 0 = none */
+#endif
 } Blk;
 
 /* Global manager */
@@ -78,19 +359,63 @@ typedef struct
 	Blk** table;
 	size_t capacity;
 	size_t alive;
+	int alloc_fill; /* junk byte for new blocks, -1 = off */
+	int free_fill;	/* scrub byte for freed blocks, -1 = off */
+	size_t fill_cap;
+#ifdef LEAKED_ADDR_INDEX
+	Blk* root;
+#endif
+#ifdef LEAKED_STACK_DEPTH
+	size_t stack_depth;
+#endif
 #ifdef LEAKED_THREAD_SAFE
 	pthread_mutex_t lock;
 #endif
+#ifdef LEAKED_REACHABILITY
+	/* extra ranges scanned for pointers at report time */
+	const void* roots[LEAKED_MAX_ROOTS];
+	size_t root_sz[LEAKED_MAX_ROOTS];
+	size_t nroots;
+#endif
+#ifdef LEAKED_GUARD_PAGES
+	/* unmapped guard-page mappings kept for reuse */
+	void* gp_cache[LEAKED_GUARD_CACHE];
+	size_t gp_len[LEAKED_GUARD_CACHE];
+	size_t gp_n;
+#endif
 } Mgr;
 
 #ifdef LEAKED_IMPLEMENTATION
 static Mgr mgr = { NULL,
 				   0,
-				   0
+				   0,
+				   LEAKED_ALLOC_FILL,
+				   LEAKED_FREE_FILL,
+				   LEAKED_FILL_CAP
+#ifdef LEAKED_ADDR_INDEX
+				   ,
+				   NULL
+#endif
+#ifdef LEAKED_STACK_DEPTH
+				   ,
+				   LEAKED_STACK_DEPTH
+#endif
 #ifdef LEAKED_THREAD_SAFE
 				   ,
 				   PTHREAD_MUTEX_INITIALIZER
 #endif
+#ifdef LEAKED_REACHABILITY
+				   ,
+				   { NULL },
+				   { 0 },
+				   0
+#endif
+#ifdef LEAKED_GUARD_PAGES
+				   ,
+				   { NULL },
+				   { 0 },
+				   0
+#endif
 };
 #else
 extern Mgr mgr;
@@ -154,175 +479,4698 @@ static void _maybe_resize(void)
 		_rehash(mgr.capacity * 2);
 }
 
-/* add block to the table */
-static void _add_blk(void* p, size_t sz, const char* f, int l)
+#ifdef LEAKED_ADDR_INDEX
+/*
+ * address index: the same Blk nodes also form a treap ordered by address,
+ * so the block containing an interior pointer is found in O(log n)
+ * expected. priorities are the address through the murmur3 finalizer,
+ * so blocks at regular strides still get a balanced tree, and nothing
+ * extra is stored. updates walk down from the root without recursing.
+ * it is changed together with the hash table under the same lock.
+ */
+static uint64_t _idx_prio(const Blk* b)
 {
-	if (!p) return;
-	LOCK();
-	_ensure_table_ext();
-	_maybe_resize();
-	unsigned int idx = _hash_ptr(p, mgr.capacity);
-	Blk* b = (Blk*)malloc(sizeof(Blk));
-	if (b) {
-		b->ptr = p;
-		b->sz = sz;
-		b->file = f;
-		b->line = l;
-		b->next = mgr.table[idx];
-		mgr.table[idx] = b;
-		mgr.alive++;
+	uint64_t h = (uint64_t)(uintptr_t)b->ptr;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static Blk** _idx_child(Blk* t, const Blk* b)
+{
+	return (uintptr_t)b->ptr < (uintptr_t)t->ptr ? &t->left : &t->right;
+}
+
+/* b goes where the walk down reaches a lower priority, that subtree is
+ * split around its address into b's children */
+static void _idx_insert(Blk** root, Blk* b)
+{
+	uint64_t prio = _idx_prio(b);
+	Blk** at = root;
+	while (*at && _idx_prio(*at) > prio)
+		at = _idx_child(*at, b);
+	Blk* t = *at;
+	Blk** l = &b->left;
+	Blk** r = &b->right;
+	while (t) {
+		if ((uintptr_t)t->ptr < (uintptr_t)b->ptr) {
+			*l = t;
+			l = &t->right;
+			t = t->right;
+		} else {
+			*r = t;
+			r = &t->left;
+			t = t->left;
+		}
 	}
-	UNLOCK();
+	*l = *r = NULL;
+	*at = b;
 }
 
-/* remove block, (if) report invalid frees */
-static int _del_blk(void* p, const char* f, int l)
+/* unlink b, its two subtrees are zipped together in its place */
+static void _idx_remove(Blk** root, const Blk* b)
+{
+	Blk** at = root;
+	while (*at && *at != b)
+		at = _idx_child(*at, b);
+	if (!*at) return;
+	Blk* l = b->left;
+	Blk* r = b->right;
+	while (l && r) {
+		if (_idx_prio(l) > _idx_prio(r)) {
+			*at = l;
+			at = &l->right;
+			l = l->right;
+		} else {
+			*at = r;
+			at = &r->left;
+			r = r->left;
+		}
+	}
+	*at = l ? l : r;
+}
+
+/* block with the highest start address <= addr, caller holds the lock */
+static Blk* _idx_floor(const void* addr)
+{
+	Blk* best = NULL;
+	for (Blk* t = mgr.root; t;) {
+		if ((uintptr_t)t->ptr <= (uintptr_t)addr) {
+			best = t;
+			t = t->right;
+		} else
+			t = t->left;
+	}
+	return best;
+}
+
+/* block with the lowest start address > addr, caller holds the lock */
+static Blk* _idx_above(const void* addr)
+{
+	Blk* best = NULL;
+	for (Blk* t = mgr.root; t;) {
+		if ((uintptr_t)t->ptr > (uintptr_t)addr) {
+			best = t;
+			t = t->left;
+		} else
+			t = t->right;
+	}
+	return best;
+}
+
+/* find the live block containing addr (any byte of it, not only the start).
+ * on success a copy goes to `out` (next/left/right are meaningless) */
+static int leaked_find(const void* addr, Blk* out) __attribute__((unused));
+static int leaked_find(const void* addr, Blk* out)
 {
-	if (!p) return 0;
 	int ok = 0;
 	LOCK();
-	if (mgr.table) {
-		unsigned int idx = _hash_ptr(p, mgr.capacity);
-		Blk** pp;
-		for (pp = &mgr.table[idx]; *pp; pp = &(*pp)->next) {
-			if ((*pp)->ptr == p) {
-				Blk* tmp = *pp;
-				*pp = tmp->next;
-				free(tmp);
-				mgr.alive--;
-				ok = 1;
-				break;
-			}
-		}
+	Blk* b = _idx_floor(addr);
+	if (b && (uintptr_t)addr - (uintptr_t)b->ptr < (b->sz ? b->sz : 1)) {
+		if (out) *out = *b;
+		ok = 1;
 	}
 	UNLOCK();
-	if (!ok)
-		fprintf(stderr,
-				YEL "[LEAKED]" RESET " invalid free at %p (%s:%d)\n",
-				p,
-				f,
-				l);
 	return ok;
 }
+#endif
+
+#ifdef LEAKED_SHADOW
+/*
+ * shadow map: one bit per 16-byte granule, set when a live block starts in
+ * it. the top level splits a 47-bit address space into 4 GiB regions, each
+ * region's bitmap (32 MiB of address space) is mmap'ed on first use and
+ * only the pages actually touched get backed. bits are flipped with atomics
+ * so readers never need the lock. a clear bit means "not a block start",
+ * a set bit still goes to the table for size/site.
+ */
+#define LEAKED_SHADOW_BITS 47
+#define LEAKED_SHADOW_REGION 32
+#define LEAKED_SHADOW_TOP \
+	((size_t)1 << (LEAKED_SHADOW_BITS - LEAKED_SHADOW_REGION))
+#define LEAKED_SHADOW_WORDS \
+	(((size_t)1 << (LEAKED_SHADOW_REGION - 4)) / 64)
+
+#ifdef LEAKED_IMPLEMENTATION
+static uint64_t* _shadow[LEAKED_SHADOW_TOP];
+static int _shadow_partial; /* some block couldn't be marked */
+#else
+extern uint64_t* _shadow[LEAKED_SHADOW_TOP];
+extern int _shadow_partial;
+#endif
 
-static void* _xmalloc(size_t n, const char* f, int l)
+/* bitmap word for p, mapping the region when `make` is set */
+static uint64_t* _shadow_word(const void* p, int make)
 {
-	void* p = malloc(n);
-	if (p) _add_blk(p, n, f, l);
-	return p;
+	uintptr_t a = (uintptr_t)p;
+	if (a >> LEAKED_SHADOW_BITS) return NULL;
+	size_t top = (size_t)(a >> LEAKED_SHADOW_REGION);
+	uint64_t* r = __atomic_load_n(&_shadow[top], __ATOMIC_ACQUIRE);
+	if (!r) {
+		if (!make) return NULL;
+		void* m = mmap(NULL,
+					   LEAKED_SHADOW_WORDS * sizeof(uint64_t),
+					   PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+					   -1,
+					   0);
+		if (m == MAP_FAILED) return NULL;
+		r = (uint64_t*)m;
+		uint64_t* cur = NULL;
+		if (!__atomic_compare_exchange_n(&_shadow[top],
+										 &cur,
+										 r,
+										 0,
+										 __ATOMIC_ACQ_REL,
+										 __ATOMIC_ACQUIRE)) {
+			munmap(m, LEAKED_SHADOW_WORDS * sizeof(uint64_t));
+			r = cur;
+		}
+	}
+	uintptr_t off = a & (((uintptr_t)1 << LEAKED_SHADOW_REGION) - 1);
+	return &r[(size_t)(off >> 4) / 64];
 }
 
-static void* _xcalloc(size_t nm, size_t s, const char* f, int l)
-  __attribute__((unused));
-static void* _xcalloc(size_t nm, size_t s, const char* f, int l)
+static void _shadow_set(const void* p)
 {
-	if (nm && s > ((size_t)-1) / nm) return NULL;
-	void* p = calloc(nm, s);
-	if (p) _add_blk(p, nm * s, f, l);
-	return p;
+	uint64_t* w = _shadow_word(p, 1);
+	if (w)
+		__atomic_fetch_or(w, (uint64_t)1 << (((uintptr_t)p >> 4) & 63),
+						  __ATOMIC_RELAXED);
+	else
+		_shadow_partial = 1;
 }
 
-static void* _xrealloc(void* old, size_t n, const char* f, int l)
-  __attribute__((unused));
-static void* _xrealloc(void* old, size_t n, const char* f, int l)
+static void _shadow_clear(const void* p)
 {
-	void* p = realloc(old, n);
-	if (!p) return NULL;
+	uint64_t* w = _shadow_word(p, 0);
+	if (w)
+		__atomic_fetch_and(w, ~((uint64_t)1 << (((uintptr_t)p >> 4) & 63)),
+						   __ATOMIC_RELAXED);
+}
 
-	if (old && old != p) _del_blk(old, f, l);
+/* 0 only if no live block starts in p's granule */
+static int _shadow_test(const void* p)
+{
+	if (_shadow_partial) return 1;
+	uint64_t* w = _shadow_word(p, 0);
+	return w && (__atomic_load_n(w, __ATOMIC_RELAXED) >>
+				 (((uintptr_t)p >> 4) & 63)) & 1;
+}
 
-	_add_blk(p, n, f, l);
-	return p;
+/* does a live tracked block start at p? two loads and a bit test, no lock.
+ * precision is one 16-byte granule */
+static int leaked_owns(const void* p) __attribute__((unused));
+static int leaked_owns(const void* p)
+{
+	return p && _shadow_test(p);
 }
+#endif
+
+#ifdef LEAKED_STACK_BOUNDS
+/* the calling thread's stack as pthread_getattr_np reports it (for the
+ * main thread glibc derives it from /proc/self/maps and the rlimit).
+ * bound under its own name as it is only declared for _GNU_SOURCE, and
+ * weak so a build that doesn't link it finds it missing. 0 when unknown */
+extern int _leaked_getattr_np(pthread_t th, pthread_attr_t* attr)
+  __asm__("pthread_getattr_np") __attribute__((weak));
 
-static void _xfree(void* p, const char* f, int l)
+static int _thread_stack(const unsigned char** lo, const unsigned char** hi)
 {
-	if (p && _del_blk(p, f, l)) free(p);
+	pthread_attr_t attr;
+	void* base;
+	size_t size;
+	int ok = 0;
+	if (!_leaked_getattr_np || _leaked_getattr_np(pthread_self(), &attr))
+		return 0;
+	if (!pthread_attr_getstack(&attr, &base, &size)) {
+		*lo = (const unsigned char*)base;
+		*hi = (const unsigned char*)base + size;
+		ok = 1;
+	}
+	pthread_attr_destroy(&attr);
+	return ok;
 }
+#endif
 
-/* report to stderr at this point */
-static void show_leaks(void)
+#ifdef LEAKED_STACK_DEPTH
+/*
+ * stack depot: every distinct call stack is stored once and named by a
+ * 32-bit id that the block keeps. lookups and inserts are lock-free: a
+ * fixed array of bucket lists that only ever grow at the head (CAS), plus
+ * an id -> stack table whose pages are installed with CAS as well. nodes
+ * are never freed.
+ */
+typedef struct Stack
 {
-	LOCK();
-	if (!mgr.table || mgr.alive == 0) {
-		UNLOCK();
-		return;
+	struct Stack* next;
+	uint32_t hash;
+	uint32_t id;
+	uint32_t n;
+	void* pc[];
+} Stack;
+
+#ifdef LEAKED_IMPLEMENTATION
+static Stack* _depot[LEAKED_DEPOT_BUCKETS];
+static Stack** _depot_ids[LEAKED_DEPOT_PAGES];
+static uint32_t _depot_next;
+#else
+extern Stack* _depot[LEAKED_DEPOT_BUCKETS];
+extern Stack** _depot_ids[LEAKED_DEPOT_PAGES];
+extern uint32_t _depot_next;
+#endif
+
+static uint32_t _stack_hash(void* const* pc, size_t n)
+{
+	uint64_t h = 0xcbf29ce484222325ull ^ n;
+	for (size_t i = 0; i < n; i++) {
+		h ^= (uint64_t)(uintptr_t)pc[i];
+		h *= 0x100000001b3ull;
+		h ^= h >> 29;
 	}
-	Blk** snapshot = mgr.table;
-	size_t cap_snapshot = mgr.capacity;
-	mgr.table = NULL;
-	mgr.capacity = 0;
-	mgr.alive = 0;
-	UNLOCK();
+	return (uint32_t)(h ^ (h >> 32));
+}
 
-	long total_count = 0;
-	size_t total_bytes = 0;
+/* stack for an id, NULL if unknown */
+static const Stack* _depot_get(uint32_t id)
+{
+	if (!id || (size_t)id >= LEAKED_DEPOT_PAGES * LEAKED_DEPOT_PAGE)
+		return NULL;
+	Stack** page = __atomic_load_n(&_depot_ids[id / LEAKED_DEPOT_PAGE],
+								   __ATOMIC_ACQUIRE);
+	if (!page) return NULL;
+	return __atomic_load_n(&page[id % LEAKED_DEPOT_PAGE], __ATOMIC_ACQUIRE);
+}
 
-	for (size_t i = 0; i < cap_snapshot; i++) {
-		for (Blk* b = snapshot[i]; b; b = b->next) {
-			fprintf(stderr,
-					YEL "[LEAKED]" RESET " leak: %lu bytes at %p (%s:%d)\n",
-					(unsigned long)b->sz,
-					b->ptr,
-					b->file,
-					b->line);
-			total_count++;
-			total_bytes += b->sz;
+static void _depot_publish(Stack* s)
+{
+	size_t pi = s->id / LEAKED_DEPOT_PAGE;
+	Stack** page = __atomic_load_n(&_depot_ids[pi], __ATOMIC_ACQUIRE);
+	if (!page) {
+		Stack** fresh = (Stack**)calloc(LEAKED_DEPOT_PAGE, sizeof(Stack*));
+		if (!fresh) return;
+		if (__atomic_compare_exchange_n(&_depot_ids[pi],
+										&page,
+										fresh,
+										0,
+										__ATOMIC_ACQ_REL,
+										__ATOMIC_ACQUIRE))
+			page = fresh;
+		else
+			free(fresh);
+	}
+	__atomic_store_n(&page[s->id % LEAKED_DEPOT_PAGE], s, __ATOMIC_RELEASE);
+}
+
+/* id of a stack, storing it on first sight. 0 when the depot is full */
+static uint32_t _depot_put(void* const* pc, size_t n)
+{
+	uint32_t h = _stack_hash(pc, n);
+	Stack** bucket = &_depot[h & (LEAKED_DEPOT_BUCKETS - 1)];
+	Stack* head = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+	Stack* seen = NULL; /* nodes below this one were already compared */
+	Stack* mine = NULL;
+	for (;;) {
+		for (Stack* s = head; s != seen; s = s->next)
+			if (s->hash == h && s->n == n &&
+				!memcmp(s->pc, pc, n * sizeof(void*))) {
+				free(mine); /* lost a race to an identical stack */
+				return s->id;
+			}
+		if (!mine) {
+			/* ids stop at the last one, so the counter never wraps */
+			uint32_t id = __atomic_load_n(&_depot_next, __ATOMIC_RELAXED);
+			do
+				if ((size_t)id + 1 >= LEAKED_DEPOT_PAGES * LEAKED_DEPOT_PAGE)
+					return 0;
+			while (!__atomic_compare_exchange_n(&_depot_next,
+												&id,
+												id + 1,
+												1,
+												__ATOMIC_RELAXED,
+												__ATOMIC_RELAXED));
+			id++;
+			mine = (Stack*)malloc(sizeof(Stack) + n * sizeof(void*));
+			if (!mine) return 0;
+			mine->hash = h;
+			mine->id = id;
+			mine->n = (uint32_t)n;
+			memcpy(mine->pc, pc, n * sizeof(void*));
 		}
+		seen = head;
+		mine->next = head;
+		if (__atomic_compare_exchange_n(
+			  bucket, &head, mine, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			break;
 	}
+	_depot_publish(mine);
+	return mine->id;
+}
 
-	if (total_count > 0)
-		fprintf(stderr,
-				YEL "[LEAKED]" RESET " total (%ld) leaks, (%lu) bytes\n",
-				total_count,
-				(unsigned long)total_bytes);
+#ifndef LEAKED_UNWIND_BACKTRACE
+/* where the frame walk may read, looked up once per thread. state is 0
+ * before, 1 when known, -1 when the walk has to go through backtrace */
+typedef struct
+{
+	const unsigned char* lo;
+	const unsigned char* hi;
+	int state;
+} StackBounds;
 
-	/* free snapshot */
-	for (size_t i = 0; i < cap_snapshot; i++) {
-		Blk* b = snapshot[i];
-		while (b) {
-			Blk* tmp = b;
-			b = b->next;
-			free(tmp);
+#ifdef LEAKED_IMPLEMENTATION
+static LEAKED_TLS StackBounds _stk;
+#else
+extern LEAKED_TLS StackBounds _stk;
+#endif
+#endif
+
+/* capture the stack of the code that called the allocation wrapper whose
+ * frame is `fp`, starting at that frame's return address. frames aren't
+ * counted, the compiler is free to clone wrappers or tail-call out of
+ * them */
+static LEAKED_NOINLINE uint32_t _stack_capture(void* const* fp)
+{
+	void* pc[LEAKED_STACK_DEPTH];
+	size_t depth = mgr.stack_depth;
+	size_t n = 0;
+	if (depth > (size_t)LEAKED_STACK_DEPTH) depth = LEAKED_STACK_DEPTH;
+	if (!depth || !fp) return 0;
+#ifndef LEAKED_UNWIND_BACKTRACE
+	if (!_stk.state)
+		_stk.state = _thread_stack(&_stk.lo, &_stk.hi) ? 1 : -1;
+	if (_stk.state > 0) {
+		/* each frame is [saved fp][return address]. a caller built
+		 * without frame pointers leaves any word in fp[0], so stop on
+		 * anything that isn't a frame further up this thread's stack */
+		while (n < depth) {
+			void* ret = fp[1];
+			void* const* up = (void* const*)fp[0];
+			if (!ret) break;
+			pc[n++] = ret;
+			if (up <= fp || (const unsigned char*)up < _stk.lo ||
+				(const unsigned char*)(up + 2) > _stk.hi ||
+				((uintptr_t)up & (sizeof(void*) - 1)))
+				break;
+			fp = up;
 		}
+		return n ? _depot_put(pc, n) : 0;
 	}
-	free(snapshot);
+#endif
+	/* leaked.h's own frames end where the wrapper returns to */
+	void* raw[LEAKED_STACK_DEPTH + 16];
+	int got = backtrace(raw, (int)depth + 16);
+	int i = 0;
+	while (i < got && raw[i] != fp[1])
+		i++;
+	for (; i < got && n < depth; i++)
+		pc[n++] = raw[i];
+	return n ? _depot_put(pc, n) : 0;
 }
 
-/*
- * simple crash handler
- * TODO: better handler (maybe using async signal??)
- */
-static void _crash_handler(int sig)
+/* the stack above the calling wrapper, which gets a frame by asking */
+#define LEAKED_STACK_HERE() \
+	_stack_capture((void* const*)__builtin_frame_address(0))
+
+/* frames recorded for new allocations, at most LEAKED_STACK_DEPTH */
+static void leaked_set_stack_depth(size_t n) __attribute__((unused));
+static void leaked_set_stack_depth(size_t n)
 {
-	fprintf(stderr, "\n[LEAKED] caught signal %d, dumping leaks...\n", sig);
-	show_leaks();
-	signal(sig, SIG_DFL);
-	raise(sig);
+	mgr.stack_depth = n;
 }
 
-/* print to stderr on program exit or crash */
-static void leaked_init(void)
+static void _print_stack(uint32_t id)
 {
-	static int done = 0;
-	if (!done) {
-		done = 1;
-		atexit(show_leaks);
-		signal(SIGSEGV, _crash_handler);
-		signal(SIGABRT, _crash_handler);
-		signal(SIGILL, _crash_handler);
-		signal(SIGFPE, _crash_handler);
+	const Stack* s = _depot_get(id);
+	if (!s) return;
+	for (uint32_t i = 0; i < s->n; i++)
+		fprintf(stderr, "    #%u %p\n", i, s->pc[i]);
+}
+#else
+#define LEAKED_STACK_HERE() 0u
+#endif
+
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+/* executable mappings, so raw addresses can be symbolized offline
+ * (tools/leaked-symbolize.c) */
+static void _print_maps(void)
+{
+	FILE* fp = fopen("/proc/self/maps", "r");
+	if (!fp) return;
+	char line[512];
+	while (fgets(line, sizeof(line), fp)) {
+		char* perms = strchr(line, ' ');
+		if (!perms || perms[3] != 'x' || !strchr(line, '/')) continue;
+		fprintf(stderr, YEL "[LEAKED]" RESET " map: %s", line);
 	}
+	fclose(fp);
 }
+#endif
 
-/* remap stooodss */
-#undef malloc
-#undef calloc
+#ifdef LEAKED_TRACE
+/*
+ * binary event trace. each thread encodes its events into a private
+ * buffer and writes it out as one chunk when the buffer fills, when the
+ * thread exits and at exit. writers reserve their range of the file under
+ * a short lock and pwritev() into it outside of it. integers are LEB128
+ * varints unless noted:
+ *
+ *   file    "LEAKTRC2", then chunks
+ *   chunk   type (1 byte), payload length (4 bytes LE), payload
+ *   'S'     site id, pc, line, name length, name. written once per site,
+ *           before the first chunk that uses it
+ *   'E'     thread id, t0 (ns), span, event count, events. span is how
+ *           long after t0 the last change to the heap of the chunk was
+ *   event   dt << 3 | unaligned << 2 | op   (ns since the previous event
+ *                                            of the chunk, t0 for the first)
+ *           ptr     zigzag delta of ptr / 16 against the previous event's
+ *                   ptr (0 for the first), the raw value when unaligned
+ *           size    of the block, left out for a free: a reader has it
+ *                   from the event that made the block
+ *           site    id, 0 when the site table is full
+ *           realloc also: old ptr (delta against ptr), ns from releasing
+ *           old to owning ptr
+ *   'C'     checkpoint, every LEAKED_TRACE_CHECKPOINT ms: t, block count,
+ *           blocks: size << 1 | unaligned, ptr (as in events), site
+ *   'I'     index of a trace that exited cleanly: entry count, entries:
+ *           type (1 byte), offset, t0 ('E') or t ('C'), span ('E'). ends
+ *           with the offset of the 'I' chunk itself (8 bytes LE), so a
+ *           reader finds it from the end of the file
+ *
+ * events are stamped under the table lock together with the change they
+ * describe and stamps never repeat: a malloc after the block came out of
+ * libc, a free before it goes back. merging all threads by time never has
+ * a pointer live twice, and a checkpoint at t holds exactly the changes
+ * stamped before t. a free takes about 5 bytes, a malloc 6 to 7.5 and
+ * a realloc 9 to 10, so 5.9 to 6.6 bytes per event on average depending on
+ * how spread out sizes and addresses are
+ */
+#define LEAKED_TRACE_MAGIC "LEAKTRC2"
+#define LEAKED_TRACE_MALLOC 0
+#define LEAKED_TRACE_FREE 1
+#define LEAKED_TRACE_REALLOC 2
+#ifndef LEAKED_TRACE_BUF
+#define LEAKED_TRACE_BUF ((size_t)64 << 10)
+#endif
+#define LEAKED_TRACE_SITES ((size_t)1 << 16)
+#define LEAKED_TRACE_MAX_EVENT 64 /* worst case encoded event */
+
+typedef struct
+{
+	Site at;
+	uint32_t id;
+} TSite;
+
+typedef struct
+{
+	char type; /* 'S', 'E' or 'C' */
+	uint64_t off;
+	uint64_t t0;
+	uint64_t span;
+} TIdx;
+
+typedef struct
+{
+	int fd; /* -1 not opened yet, -2 failed */
+	uint32_t threads;
+	uint32_t sites;
+	uint64_t size;		/* of the file, reserved so far */
+	uint64_t stamp;		/* last one handed out, under LOCK */
+	uint64_t next_ckpt; /* due time of the next checkpoint */
+	TIdx* idx;
+	size_t nidx;
+	size_t cap_idx;
+#ifdef LEAKED_THREAD_SAFE
+	pthread_mutex_t lock; /* size and idx */
+#endif
+	TSite* site[LEAKED_TRACE_SITES]; /* open addressing, never removed */
+} Trace;
+
+typedef struct
+{
+	unsigned char* buf;
+	size_t len;
+	uint32_t tid;
+	uint32_t n;
+	uint64_t t0;
+	uint64_t last;
+	uint64_t end; /* latest change, realloc gaps included */
+	uint64_t stamp; /* of this thread's last table change */
+	uintptr_t prev;
+} TBuf;
+
+#ifdef LEAKED_IMPLEMENTATION
+static Trace trace = { -1,
+					   0,
+					   0,
+					   8,
+					   0,
+					   0,
+					   NULL,
+					   0,
+					   0,
+#ifdef LEAKED_THREAD_SAFE
+					   PTHREAD_MUTEX_INITIALIZER,
+#endif
+					   { NULL } };
+static LEAKED_TLS TBuf tbuf;
+#else
+extern Trace trace;
+extern LEAKED_TLS TBuf tbuf;
+#endif
+
+#ifdef LEAKED_THREAD_SAFE
+#define TRACE_LOCK() pthread_mutex_lock(&trace.lock)
+#define TRACE_UNLOCK() pthread_mutex_unlock(&trace.lock)
+#else
+#define TRACE_LOCK() ((void)0)
+#define TRACE_UNLOCK() ((void)0)
+#endif
+
+static uint64_t _trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* time of a table change, called under LOCK */
+static uint64_t _trace_stamp(void)
+{
+	uint64_t t = _trace_now();
+	if (t <= trace.stamp) t = trace.stamp + 1;
+	return trace.stamp = t;
+}
+
+static unsigned char* _put_varint(unsigned char* o, uint64_t v)
+{
+	while (v >= 0x80) {
+		*o++ = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	*o++ = (unsigned char)v;
+	return o;
+}
+
+static unsigned char*
+_put_ptr(unsigned char* o, uintptr_t p, uintptr_t prev, int raw)
+{
+	if (raw) return _put_varint(o, p);
+	int64_t d = (int64_t)(p >> 4) - (int64_t)(prev >> 4);
+	return _put_varint(o, ((uint64_t)d << 1) ^ (uint64_t)(d >> 63));
+}
+
+/* one chunk, header and payload in a single write. its range of the file
+ * is reserved and indexed under the trace lock */
+static void _trace_write(char type,
+						 const unsigned char* head,
+						 size_t hn,
+						 const unsigned char* body,
+						 size_t bn,
+						 uint64_t t0,
+						 uint64_t span)
+{
+	unsigned char h[5];
+	uint32_t len = (uint32_t)(hn + bn);
+	h[0] = (unsigned char)type;
+	for (int i = 0; i < 4; i++)
+		h[1 + i] = (unsigned char)(len >> (8 * i));
+	struct iovec iov[3] = { { h, 5 },
+							{ (void*)head, hn },
+							{ (void*)body, bn } };
+	TRACE_LOCK();
+	uint64_t off = trace.size;
+	trace.size += 5 + len;
+	if (trace.nidx == trace.cap_idx) {
+		size_t cap = trace.cap_idx ? trace.cap_idx * 2 : 256;
+		TIdx* idx = (TIdx*)realloc(trace.idx, cap * sizeof(TIdx));
+		if (idx) {
+			trace.idx = idx;
+			trace.cap_idx = cap;
+		}
+	}
+	if (trace.nidx < trace.cap_idx) {
+		TIdx* e = &trace.idx[trace.nidx++];
+		e->type = type;
+		e->off = off;
+		e->t0 = t0;
+		e->span = span;
+	} else
+		trace.cap_idx = (size_t)-1; /* out of memory, no index */
+	TRACE_UNLOCK();
+	if (pwritev(trace.fd, iov, 3, (off_t)off) != (ssize_t)(5 + len))
+		fprintf(stderr, YEL "[LEAKED]" RESET " short write to trace\n");
+}
+
+static void _trace_flush(TBuf* t)
+{
+	if (!t->n || trace.fd < 0) return;
+	unsigned char head[48];
+	unsigned char* o = _put_varint(head, t->tid);
+	o = _put_varint(o, t->t0);
+	o = _put_varint(o, t->end - t->t0);
+	o = _put_varint(o, t->n);
+	_trace_write(
+	  'E', head, (size_t)(o - head), t->buf, t->len, t->t0, t->end - t->t0);
+	t->len = 0;
+	t->n = 0;
+}
+
+/* the 'I' chunk, last in the file unless other threads are still busy */
+static void _trace_index(void)
+{
+	TRACE_LOCK();
+	size_t n = trace.nidx;
+	unsigned char* buf = NULL;
+	if (trace.cap_idx != (size_t)-1)
+		buf = (unsigned char*)malloc(n * 31 + 18);
+	if (buf) {
+		unsigned char* o = _put_varint(buf, n);
+		for (size_t i = 0; i < n; i++) {
+			const TIdx* e = &trace.idx[i];
+			*o++ = (unsigned char)e->type;
+			o = _put_varint(o, e->off);
+			o = _put_varint(o, e->t0);
+			o = _put_varint(o, e->span);
+		}
+		uint64_t off = trace.size;
+		for (int i = 0; i < 8; i++)
+			*o++ = (unsigned char)(off >> (8 * i));
+		size_t len = (size_t)(o - buf);
+		unsigned char h[5];
+		h[0] = 'I';
+		for (int i = 0; i < 4; i++)
+			h[1 + i] = (unsigned char)(len >> (8 * i));
+		trace.size += 5 + len;
+		TRACE_UNLOCK();
+		struct iovec iov[2] = { { h, 5 }, { buf, len } };
+		if (pwritev(trace.fd, iov, 2, (off_t)off) != (ssize_t)(5 + len))
+			fprintf(stderr, YEL "[LEAKED]" RESET " short write to trace\n");
+		free(buf);
+		return;
+	}
+	TRACE_UNLOCK();
+}
+
+static void _trace_exit(void)
+{
+	_trace_flush(&tbuf);
+	if (trace.fd >= 0) _trace_index();
+}
+
+/* open the trace on first use, returns the fd or < 0 */
+static int _trace_open(void)
+{
+	int fd = __atomic_load_n(&trace.fd, __ATOMIC_ACQUIRE);
+	if (fd != -1) return fd;
+	LOCK();
+	fd = trace.fd;
+	if (fd == -1) {
+		fd = open(LEAKED_TRACE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd >= 0 && write(fd, LEAKED_TRACE_MAGIC, 8) != 8) {
+			close(fd);
+			fd = -1;
+		}
+		if (fd < 0) {
+			fprintf(stderr,
+					YEL "[LEAKED]" RESET " can't write trace %s\n",
+					LEAKED_TRACE);
+			fd = -2;
+		} else
+			atexit(_trace_exit);
+#ifdef LEAKED_TRACE_CHECKPOINT
+		trace.next_ckpt =
+		  _trace_now() + (uint64_t)LEAKED_TRACE_CHECKPOINT * 1000000u;
+#endif
+		__atomic_store_n(&trace.fd, fd, __ATOMIC_RELEASE);
+	}
+	UNLOCK();
+	return fd;
+}
+
+#ifdef LEAKED_THREAD_SAFE
+static pthread_key_t _trace_key;
+static pthread_once_t _trace_once = PTHREAD_ONCE_INIT;
+
+/* flush a thread's buffer when it exits */
+static void _trace_thread_exit(void* arg)
+{
+	(void)arg;
+	_trace_flush(&tbuf);
+	free(tbuf.buf);
+	memset(&tbuf, 0, sizeof(tbuf));
+}
+
+static void _trace_key_init(void)
+{
+	pthread_key_create(&_trace_key, _trace_thread_exit);
+}
+#endif
+
+static int _trace_thread_init(TBuf* t)
+{
+	if (_trace_open() < 0) return 0;
+	t->buf = (unsigned char*)malloc(LEAKED_TRACE_BUF);
+	if (!t->buf) return 0;
+	t->tid = __atomic_add_fetch(&trace.threads, 1, __ATOMIC_RELAXED);
+#ifdef LEAKED_THREAD_SAFE
+	pthread_once(&_trace_once, _trace_key_init);
+	pthread_setspecific(_trace_key, t);
+#endif
+	return 1;
+}
+
+/* the 'S' chunk naming a site */
+static void _trace_site_record(const TSite* s)
+{
+#ifdef LEAKED_RETADDR
+	const char* name = "";
+	uint64_t pc = (uintptr_t)s->at.pc, line = 0;
+#else
+	const char* name = s->at.file;
+	uint64_t pc = 0, line = (uint64_t)s->at.line;
+#endif
+	unsigned char head[48];
+	unsigned char* o = _put_varint(head, s->id);
+	o = _put_varint(o, pc);
+	o = _put_varint(o, line);
+	o = _put_varint(o, strlen(name));
+	_trace_write('S',
+				 head,
+				 (size_t)(o - head),
+				 (const unsigned char*)name,
+				 strlen(name),
+				 0,
+				 0);
+}
+
+/* register a new site under the lock, probing from slot k. the table is
+ * kept at most half full */
+static uint32_t _trace_site_add(Site at, size_t k)
+{
+	uint32_t id = 0;
+	LOCK();
+	TSite* s;
+	while ((s = trace.site[k]) && !_site_eq(s->at, at))
+		k = (k + 1) & (LEAKED_TRACE_SITES - 1);
+	if (s)
+		id = s->id;
+	else if (trace.sites < LEAKED_TRACE_SITES / 2 &&
+			 (s = (TSite*)malloc(sizeof(TSite)))) {
+		s->at = at;
+		s->id = id = ++trace.sites;
+		_trace_site_record(s);
+		__atomic_store_n(&trace.site[k], s, __ATOMIC_RELEASE);
+	}
+	UNLOCK();
+	return id;
+}
+
+static uint32_t _trace_site(Site at)
+{
+#ifdef LEAKED_RETADDR
+	uint64_t h = (uintptr_t)at.pc;
+#else
+	uint64_t h = (uintptr_t)at.file * 31 + (uint64_t)at.line;
+#endif
+	size_t k = (size_t)((h * 0x9e3779b97f4a7c15ull) >> 48);
+	for (;;) {
+		TSite* s = __atomic_load_n(&trace.site[k], __ATOMIC_ACQUIRE);
+		if (!s) return _trace_site_add(at, k);
+		if (_site_eq(s->at, at)) return s->id;
+		k = (k + 1) & (LEAKED_TRACE_SITES - 1);
+	}
+}
+
+#ifdef LEAKED_TRACE_CHECKPOINT
+/* write every live block as a 'C' chunk. the table is copied under the
+ * lock, which costs a pass over the live heap every interval, and
+ * encoded after it's released */
+static void _trace_checkpoint(void)
+{
+	LOCK();
+	uint64_t t = _trace_stamp();
+	size_t n = 0;
+	Blk* copy = mgr.table ? (Blk*)malloc((mgr.alive + 1) * sizeof(Blk)) : NULL;
+	if (copy)
+		for (size_t i = 0; i < mgr.capacity; i++)
+			for (Blk* b = mgr.table[i]; b; b = b->next)
+				copy[n++] = *b;
+	UNLOCK();
+	if (!copy) return;
+	unsigned char* buf = (unsigned char*)malloc(n * 25 + 1);
+	if (buf) {
+		unsigned char head[24];
+		unsigned char* o = buf;
+		uintptr_t prev = 0;
+		for (size_t i = 0; i < n; i++) {
+			uintptr_t u = (uintptr_t)copy[i].ptr;
+			int raw = (u & 15) != 0;
+			o = _put_varint(o, (uint64_t)copy[i].sz << 1 | (uint64_t)raw);
+			o = _put_ptr(o, u, prev, raw);
+			o = _put_varint(o, _trace_site(copy[i].at));
+			prev = u;
+		}
+		size_t len = (size_t)(o - buf);
+		o = _put_varint(head, t);
+		o = _put_varint(o, n);
+		if (len < ((size_t)1 << 31))
+			_trace_write('C', head, (size_t)(o - head), buf, len, t, 0);
+		free(buf);
+	}
+	free(copy);
+}
+#endif
+
+/* record one event on block u (v: the old block of a realloc). `t` is
+ * when u, or v for a realloc, changed hands, `gap` how much later a
+ * realloc came to own u */
+static void _trace_event(int op,
+						 uintptr_t u,
+						 uintptr_t v,
+						 size_t sz,
+						 Site at,
+						 uint64_t t,
+						 uint64_t gap)
+{
+	TBuf* tb = &tbuf;
+	if (!tb->buf && !_trace_thread_init(tb)) return;
+	uint32_t site = _trace_site(at);
+	if (LEAKED_TRACE_BUF - tb->len < LEAKED_TRACE_MAX_EVENT) _trace_flush(tb);
+	if (!tb->n) {
+		tb->t0 = tb->last = tb->end = t;
+		tb->prev = 0;
+	}
+	int raw = ((u | v) & 15) != 0;
+	uint64_t dt = t > tb->last ? t - tb->last : 0;
+	unsigned char* o = tb->buf + tb->len;
+	o = _put_varint(o, dt << 3 | (uint64_t)raw << 2 | (uint64_t)op);
+	o = _put_ptr(o, u, tb->prev, raw);
+	if (op != LEAKED_TRACE_FREE) o = _put_varint(o, sz);
+	o = _put_varint(o, site);
+	if (op == LEAKED_TRACE_REALLOC) {
+		o = _put_ptr(o, v, u, raw);
+		o = _put_varint(o, gap);
+	}
+	tb->prev = u;
+	tb->last = t > tb->last ? t : tb->last;
+	tb->end = t + gap > tb->end ? t + gap : tb->end;
+	tb->len = (size_t)(o - tb->buf);
+	tb->n++;
+#ifdef LEAKED_TRACE_CHECKPOINT
+	uint64_t due = __atomic_load_n(&trace.next_ckpt, __ATOMIC_RELAXED);
+	if (t >= due &&
+		__atomic_compare_exchange_n(&trace.next_ckpt,
+									&due,
+									t + (uint64_t)LEAKED_TRACE_CHECKPOINT *
+										  1000000u,
+									0,
+									__ATOMIC_RELAXED,
+									__ATOMIC_RELAXED))
+		_trace_checkpoint();
+#endif
+}
+#endif
+
+#ifdef LEAKED_SITE_STATS
+/*
+ * per-site totals, one entry per allocation site (and stack, with
+ * LEAKED_STACK_DEPTH) found through an open addressing table of ids.
+ * kept under the lock by _add_blk/_del_blk, blocks remember their entry
+ */
+typedef struct
+{
+	Site at;
+#ifdef LEAKED_STACK_DEPTH
+	uint32_t stack;
+#endif
+	size_t allocs;
+	size_t alloc_bytes;
+	size_t live;
+	size_t live_bytes;
+	size_t peak_live; /* most blocks live at once */
+	size_t peak_bytes; /* most bytes live at once */
+#ifdef LEAKED_SLACK
+	size_t live_slack; /* usable bytes past what was asked for */
+	size_t alloc_slack;
+#endif
+#ifdef LEAKED_SUPPRESS
+	int suppressed;
+	uint32_t supp_gen; /* the rules it was last checked against */
+#endif
+} SiteStat;
+
+typedef struct
+{
+	SiteStat* s; /* by id - 1 */
+	uint32_t n;
+	uint32_t cap;
+	uint32_t* slot; /* ids, 0 = empty */
+	size_t nslot;
+	/* every block, site or not. the peaks are high-water marks each on
+	 * their own, not taken at the same moment */
+	size_t live;
+	size_t live_bytes;
+	size_t peak;
+	size_t peak_bytes;
+#ifdef LEAKED_SLACK
+	size_t live_slack;
+	size_t alloc_bytes;
+	size_t alloc_slack;
+#endif
+#ifdef LEAKED_PEAK_TOP
+	SiteStat top[LEAKED_PEAK_TOP]; /* biggest sites at the last snapshot */
+	uint32_t ntop;
+	size_t top_bytes; /* live bytes at the last snapshot */
+	size_t top_next;  /* next snapshot once live bytes go past this */
+#endif
+} Stats;
+
+#ifdef LEAKED_IMPLEMENTATION
+static Stats stats;
+#else
+extern Stats stats;
+#endif
+
+#ifdef LEAKED_STACK_DEPTH
+#define LEAKED_STAT_STACK(e) ((e)->stack)
+#else
+#define LEAKED_STAT_STACK(e) 0u
+#endif
+
+#ifdef LEAKED_SUPPRESS
+/*
+ * suppressions, one rule per line of the file loaded by leaked_init (or
+ * given to leaked_suppress):
+ *   file GLOB   file of the site (its module with LEAKED_RETADDR)
+ *   func GLOB   function the allocation was made in
+ *   stack GLOB  any function or module on the allocation stack
+ * rules are parsed once. allocations never match anything: site entries
+ * are classified outside the lock when a report copies them, and the
+ * answer is kept in the table with the generation of the rules it was
+ * made against, so an entry is matched once (again only after new rules)
+ * and a block is checked through its entry. within a pass each file name
+ * and each return address is matched once, a return address costs one
+ * backtrace_symbols(3) call whatever the number of rules. functions need
+ * LEAKED_RETADDR or LEAKED_STACK_DEPTH, and -rdynamic for the
+ * executable's own
+ */
+#define LEAKED_SUPP_FILE 0
+#define LEAKED_SUPP_FUNC 1
+#define LEAKED_SUPP_STACK 2
+
+typedef struct
+{
+	int kind;
+	int line; /* a file glob that may match "file:line" beyond the file */
+	char* glob;
+} SuppRule;
+
+typedef struct
+{
+	SuppRule* r;
+	size_t n;
+	size_t cap;
+	uint32_t gen; /* bumped by every rule */
+} Supp;
+
+#ifdef LEAKED_IMPLEMENTATION
+static Supp supp;
+#else
+extern Supp supp;
+#endif
+
+/* what a pass has already worked out for a file name or return address,
+ * -1 when not yet. keyed by pointer, file names are literals */
+typedef struct
+{
+	const void* key;
+	int hit;
+} SuppMemo;
+
+static int* _supp_memo(SuppMemo* m, size_t mask, const void* key)
+{
+	static int none = 0;
+	if (!key) return &none;
+	size_t i = (size_t)(((uintptr_t)key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+	while (m[i].key && m[i].key != key)
+		i = (i + 1) & mask;
+	if (!m[i].key) {
+		m[i].key = key;
+		m[i].hit = -1;
+	}
+	return &m[i].hit;
+}
+
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+/* the kinds of rule (bit 1 << kind) matching the module or function
+ * around a return address */
+static int _supp_pc(const void* pc, const SuppRule* r, size_t nr)
+{
+	/* "module(function+0x1f) [0x...]" */
+	void* at = (char*)pc - 1;
+	char** sym = pc ? backtrace_symbols(&at, 1) : NULL;
+	if (!sym) return 0;
+	char* fn = strchr(sym[0], '(');
+	int hit = 0;
+	if (fn) {
+		*fn++ = 0;
+		fn[strcspn(fn, "+)")] = 0;
+		for (size_t i = 0; i < nr; i++)
+			if ((r[i].kind != LEAKED_SUPP_FUNC &&
+				 !fnmatch(r[i].glob, sym[0], 0)) ||
+				(r[i].kind != LEAKED_SUPP_FILE && *fn &&
+				 !fnmatch(r[i].glob, fn, 0)))
+				hit |= 1 << r[i].kind;
+	}
+	free(sym);
+	return hit;
+}
+#endif
+
+/* whether any rule covers an entry */
+static int _supp_entry(const SiteStat* e,
+					   const SuppRule* r,
+					   size_t nr,
+					   SuppMemo* memo,
+					   size_t mask)
+{
+	int* h;
+#ifdef LEAKED_RETADDR
+	h = _supp_memo(memo, mask, e->at.pc);
+	if (*h < 0) *h = _supp_pc(e->at.pc, r, nr);
+	if (*h) return 1;
+#else
+	h = _supp_memo(memo, mask, e->at.file);
+	if (*h < 0) {
+		*h = 0;
+		for (size_t i = 0; i < nr && !*h; i++)
+			*h = r[i].kind == LEAKED_SUPP_FILE &&
+				 !fnmatch(r[i].glob, e->at.file, 0);
+	}
+	if (*h) return 1;
+	char at[4096];
+	at[0] = 0;
+	for (size_t i = 0; i < nr; i++) {
+		if (r[i].kind != LEAKED_SUPP_FILE || !r[i].line) continue;
+		if (!at[0]) snprintf(at, sizeof(at), "%s:%d", e->at.file, e->at.line);
+		if (!fnmatch(r[i].glob, at, 0)) return 1;
+	}
+#endif
+#ifdef LEAKED_STACK_DEPTH
+	const Stack* st = _depot_get(e->stack);
+	for (uint32_t i = 0; st && i < st->n; i++) {
+		h = _supp_memo(memo, mask, st->pc[i]);
+		if (*h < 0) *h = _supp_pc(st->pc[i], r, nr);
+		if ((*h & (1 << LEAKED_SUPP_STACK)) ||
+			(!i && (*h & (1 << LEAKED_SUPP_FUNC))))
+			return 1;
+	}
+#endif
+	return 0;
+}
+
+/* classify the entries of a _stat_copy that the current rules haven't
+ * seen, outside the lock, and keep the answers in the table */
+static void _supp_classify(SiteStat* site, uint32_t n)
+{
+	LOCK();
+	uint32_t gen = supp.gen;
+	size_t nr = supp.n;
+	SuppRule* r = (SuppRule*)malloc((nr ? nr : 1) * sizeof(SuppRule));
+	if (r && nr) memcpy(r, supp.r, nr * sizeof(SuppRule));
+	UNLOCK();
+	size_t keys = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		if (site[i].supp_gen == gen) continue;
+		keys++;
+#ifdef LEAKED_STACK_DEPTH
+		const Stack* st = _depot_get(site[i].stack);
+		if (st) keys += st->n;
+#endif
+	}
+	size_t mask = 15;
+	while (mask < 2 * keys)
+		mask = mask * 2 + 1;
+	SuppMemo* memo = keys ? (SuppMemo*)calloc(mask + 1, sizeof(SuppMemo))
+						  : NULL;
+	if (!r || (keys && !memo)) {
+		/* keep whatever the entries said before */
+		free(memo);
+		free(r);
+		return;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		if (site[i].supp_gen == gen) continue;
+		site[i].suppressed = _supp_entry(&site[i], r, nr, memo, mask);
+		site[i].supp_gen = gen;
+	}
+	free(memo);
+	free(r);
+	if (!keys) return;
+	LOCK();
+	for (uint32_t i = 0; i < n; i++) {
+		if (stats.s[i].supp_gen == gen) continue;
+		stats.s[i].suppressed = site[i].suppressed;
+		stats.s[i].supp_gen = gen;
+	}
+	UNLOCK();
+}
+
+/* whether b belongs to a suppressed entry of `site` (a _stat_copy) */
+static int _suppressed(const Blk* b, const SiteStat* site, uint32_t n)
+{
+	return b->stat && b->stat <= n && site[b->stat - 1].suppressed;
+}
+
+/* add a rule ("func cache_init*"), 0 on success */
+static int leaked_suppress(const char* rule) __attribute__((unused));
+static int leaked_suppress(const char* rule)
+{
+	static const char* const kinds[] = { "file", "func", "stack" };
+	while (*rule == ' ' || *rule == '\t')
+		rule++;
+	size_t k = strcspn(rule, " \t");
+	int kind = -1;
+	for (int i = 0; i < 3; i++)
+		if (strlen(kinds[i]) == k && !strncmp(rule, kinds[i], k)) kind = i;
+	const char* g = rule + k + strspn(rule + k, " \t");
+	size_t glen = strcspn(g, " \t\r\n");
+	if (kind < 0 || !glen) return -1;
+	char* glob = (char*)malloc(glen + 1);
+	if (!glob) return -1;
+	memcpy(glob, g, glen);
+	glob[glen] = 0;
+	LOCK();
+	if (supp.n == supp.cap) {
+		size_t cap = supp.cap ? supp.cap * 2 : 16;
+		SuppRule* r = (SuppRule*)realloc(supp.r, cap * sizeof(SuppRule));
+		if (!r) {
+			UNLOCK();
+			free(glob);
+			return -1;
+		}
+		supp.r = r;
+		supp.cap = cap;
+	}
+	supp.r[supp.n].kind = kind;
+	supp.r[supp.n].line = strpbrk(glob, ":*?[") != NULL;
+	supp.r[supp.n].glob = glob;
+	supp.n++;
+	supp.gen++;
+	UNLOCK();
+	return 0;
+}
+
+/* add the rules of a file, blank lines and # comments skipped. the
+ * number of rules added, -1 when it can't be read */
+static long leaked_load_suppressions(const char* path)
+  __attribute__((unused));
+static long leaked_load_suppressions(const char* path)
+{
+	FILE* fp = fopen(path, "r");
+	if (!fp) return -1;
+	char line[4096];
+	long n = 0;
+	for (int no = 1; fgets(line, sizeof(line), fp); no++) {
+		const char* p = line + strspn(line, " \t");
+		if (!*p || *p == '#' || *p == '\n' || *p == '\r') continue;
+		if (leaked_suppress(p))
+			fprintf(stderr,
+					YEL "[LEAKED]" RESET " bad suppression at %s:%d\n",
+					path,
+					no);
+		else
+			n++;
+	}
+	fclose(fp);
+	return n;
+}
+#endif
+
+static size_t _stat_hash(Site at, uint32_t stack)
+{
+#ifdef LEAKED_RETADDR
+	uint64_t h = (uintptr_t)at.pc;
+#else
+	uint64_t h = (uintptr_t)at.file * 31 + (uint64_t)at.line;
+#endif
+	return (size_t)(((h ^ stack) * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+/* entry of a site, added on first sight. 0 when out of memory */
+static uint32_t _stat_id(Site at, uint32_t stack)
+{
+	if (2 * ((size_t)stats.n + 1) > stats.nslot) {
+		size_t nslot = stats.nslot ? stats.nslot * 2 : 1024;
+		uint32_t* slot = (uint32_t*)calloc(nslot, sizeof(uint32_t));
+		if (!slot) return 0;
+		for (uint32_t id = 1; id <= stats.n; id++) {
+			const SiteStat* e = &stats.s[id - 1];
+			size_t k = _stat_hash(e->at, LEAKED_STAT_STACK(e)) & (nslot - 1);
+			while (slot[k])
+				k = (k + 1) & (nslot - 1);
+			slot[k] = id;
+		}
+		free(stats.slot);
+		stats.slot = slot;
+		stats.nslot = nslot;
+	}
+	size_t k = _stat_hash(at, stack) & (stats.nslot - 1);
+	for (uint32_t id; (id = stats.slot[k]); k = (k + 1) & (stats.nslot - 1)) {
+		const SiteStat* e = &stats.s[id - 1];
+		if (_site_eq(e->at, at) && LEAKED_STAT_STACK(e) == stack) return id;
+	}
+	if (stats.n == stats.cap) {
+		uint32_t cap = stats.cap ? stats.cap * 2 : 256;
+		SiteStat* s = (SiteStat*)realloc(stats.s, cap * sizeof(SiteStat));
+		if (!s) return 0;
+		stats.s = s;
+		stats.cap = cap;
+	}
+	SiteStat* e = &stats.s[stats.n];
+	memset(e, 0, sizeof(*e));
+	e->at = at;
+#ifdef LEAKED_STACK_DEPTH
+	e->stack = stack;
+#endif
+	stats.slot[k] = ++stats.n;
+	return stats.n;
+}
+
+#ifdef LEAKED_PEAK_TOP
+/* keep the sites holding the most bytes right now, biggest first. runs
+ * under the lock, at most once per LEAKED_PEAK_STEP percent of growth */
+static void _peak_snapshot(void)
+{
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < stats.n; i++) {
+		const SiteStat* e = &stats.s[i];
+		if (!e->live_bytes || (n == (uint32_t)(LEAKED_PEAK_TOP) &&
+							   e->live_bytes <= stats.top[n - 1].live_bytes))
+			continue;
+		uint32_t k = n < (uint32_t)(LEAKED_PEAK_TOP) ? n++ : n - 1;
+		for (; k && stats.top[k - 1].live_bytes < e->live_bytes; k--)
+			stats.top[k] = stats.top[k - 1];
+		stats.top[k] = *e;
+	}
+	stats.ntop = n;
+	stats.top_bytes = stats.live_bytes;
+	/* live * STEP / 100 without overflowing the product */
+	size_t step = stats.live_bytes / 100 * (size_t)(LEAKED_PEAK_STEP) +
+				  stats.live_bytes % 100 * (size_t)(LEAKED_PEAK_STEP) / 100;
+	if (step < (size_t)(LEAKED_PEAK_MIN)) step = (size_t)(LEAKED_PEAK_MIN);
+	stats.top_next = stats.live_bytes > SIZE_MAX - step
+					   ? SIZE_MAX : stats.live_bytes + step;
+}
+#endif
+
+static void _stat_alloc(Blk* b)
+{
+	b->stat = _stat_id(b->at, LEAKED_STAT_STACK(b));
+	if (b->stat) {
+		SiteStat* e = &stats.s[b->stat - 1];
+		e->allocs++;
+		e->alloc_bytes += b->sz;
+		e->live++;
+		e->live_bytes += b->sz;
+		if (e->live > e->peak_live) e->peak_live = e->live;
+		if (e->live_bytes > e->peak_bytes) e->peak_bytes = e->live_bytes;
+#ifdef LEAKED_SLACK
+		e->live_slack += b->slack;
+		e->alloc_slack += b->slack;
+#endif
+	}
+	stats.live++;
+	stats.live_bytes += b->sz;
+	if (stats.live > stats.peak) stats.peak = stats.live;
+	if (stats.live_bytes > stats.peak_bytes)
+		stats.peak_bytes = stats.live_bytes;
+#ifdef LEAKED_SLACK
+	stats.live_slack += b->slack;
+	stats.alloc_bytes += b->sz;
+	stats.alloc_slack += b->slack;
+#endif
+#ifdef LEAKED_PEAK_TOP
+	if (stats.live_bytes > stats.top_next) _peak_snapshot();
+#endif
+}
+
+#ifndef LEAKED_SLOW_FREE
+/* a block _stat_free took out put back as it was, live again but not a
+ * new allocation */
+static void _stat_readd(const Blk* b)
+{
+	stats.live++;
+	stats.live_bytes += b->sz;
+	if (stats.live > stats.peak) stats.peak = stats.live;
+	if (stats.live_bytes > stats.peak_bytes)
+		stats.peak_bytes = stats.live_bytes;
+#ifdef LEAKED_SLACK
+	stats.live_slack += b->slack;
+#endif
+	if (!b->stat) return;
+	SiteStat* e = &stats.s[b->stat - 1];
+	e->live++;
+	e->live_bytes += b->sz;
+	if (e->live > e->peak_live) e->peak_live = e->live;
+	if (e->live_bytes > e->peak_bytes) e->peak_bytes = e->live_bytes;
+#ifdef LEAKED_SLACK
+	e->live_slack += b->slack;
+#endif
+}
+#endif
+
+static void _stat_free(const Blk* b)
+{
+	stats.live--;
+	stats.live_bytes -= b->sz;
+#ifdef LEAKED_SLACK
+	stats.live_slack -= b->slack;
+#endif
+	if (!b->stat) return;
+	SiteStat* e = &stats.s[b->stat - 1];
+	e->live--;
+	e->live_bytes -= b->sz;
+#ifdef LEAKED_SLACK
+	e->live_slack -= b->slack;
+#endif
+}
+
+/* high-water marks of live bytes, and of live blocks in `blocks` */
+static size_t leaked_peak(size_t* blocks) __attribute__((unused));
+static size_t leaked_peak(size_t* blocks)
+{
+	LOCK();
+	size_t bytes = stats.peak_bytes;
+	if (blocks) *blocks = stats.peak;
+	UNLOCK();
+	return bytes;
+}
+
+#ifdef LEAKED_SLACK
+/* bytes the allocator handed out past the sizes asked for, over the live
+ * blocks, and over every allocation so far in `total` */
+static size_t leaked_slack(size_t* total) __attribute__((unused));
+static size_t leaked_slack(size_t* total)
+{
+	LOCK();
+	size_t bytes = stats.live_slack;
+	if (total) *total = stats.alloc_slack;
+	UNLOCK();
+	return bytes;
+}
+#endif
+
+/* the entries as they are now, for the writers to walk unlocked */
+static SiteStat* _stat_copy(uint32_t* n)
+{
+	LOCK();
+	*n = stats.n;
+	SiteStat* copy = (SiteStat*)malloc((*n + 1) * sizeof(SiteStat));
+	if (copy && *n) memcpy(copy, stats.s, *n * sizeof(SiteStat));
+	UNLOCK();
+#ifdef LEAKED_SUPPRESS
+	if (copy) _supp_classify(copy, *n);
+#endif
+	return copy;
+}
+
+#ifdef LEAKED_PEAK_TOP
+static void _print_peak(void)
+{
+	SiteStat top[LEAKED_PEAK_TOP];
+	LOCK();
+	size_t peak = stats.peak, peak_bytes = stats.peak_bytes;
+	size_t at = stats.top_bytes;
+	uint32_t n = stats.ntop;
+	memcpy(top, stats.top, n * sizeof(SiteStat));
+	UNLOCK();
+	if (!n) return;
+	fprintf(stderr,
+			YEL "[LEAKED]" RESET " peak (%lu) blocks, (%lu) bytes, biggest "
+				"sites at %lu bytes:\n",
+			(unsigned long)peak,
+			(unsigned long)peak_bytes,
+			(unsigned long)at);
+	for (uint32_t i = 0; i < n; i++) {
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET "   %lu bytes in (%lu) blocks (" SITE_FMT
+					")\n",
+				(unsigned long)top[i].live_bytes,
+				(unsigned long)top[i].live,
+				SITE_ARG(top[i].at));
+#ifdef LEAKED_STACK_DEPTH
+		_print_stack(top[i].stack);
+#endif
+	}
+}
+#endif
+
+#ifdef LEAKED_SLACK
+#ifndef LEAKED_SLACK_TOP
+#define LEAKED_SLACK_TOP 5
+#endif
+static int _slack_cmp(const void* a, const void* b)
+{
+	size_t x = ((const SiteStat*)a)->alloc_slack;
+	size_t y = ((const SiteStat*)b)->alloc_slack;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* what rounding cost over the whole run, and the sites that lost the most
+ * to it, with their average request size */
+static void _print_slack(void)
+{
+	uint32_t n;
+	SiteStat* site = _stat_copy(&n);
+	if (!site) return;
+	LOCK();
+	size_t bytes = stats.alloc_bytes, slack = stats.alloc_slack;
+	UNLOCK();
+	if (slack) {
+		qsort(site, n, sizeof(SiteStat), _slack_cmp);
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " slack (%lu) bytes over (%lu) "
+					"requested (%.1f%%), most at:\n",
+				(unsigned long)slack,
+				(unsigned long)bytes,
+				bytes ? 100.0 * (double)slack / (double)bytes : 0.0);
+	}
+	for (uint32_t i = 0; slack && i < n && i < LEAKED_SLACK_TOP; i++) {
+		const SiteStat* e = &site[i];
+		if (!e->alloc_slack) break;
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET "   %lu bytes in (%lu) allocs of %lu "
+					"bytes on average (" SITE_FMT ")\n",
+				(unsigned long)e->alloc_slack,
+				(unsigned long)e->allocs,
+				(unsigned long)(e->alloc_bytes / e->allocs),
+				SITE_ARG(e->at));
+#ifdef LEAKED_STACK_DEPTH
+		_print_stack(e->stack);
+#endif
+	}
+	free(site);
+}
+#endif
+#endif
+
+#ifdef LEAKED_QUOTA
+/* a byte limit and what to do when an allocation would cross it */
+typedef struct
+{
+	size_t limit; /* 0 = none */
+	int action;	  /* LEAKED_QUOTA_* bits */
+	int logged;
+} Quota;
+#endif
+
+#ifdef LEAKED_TAGS
+/*
+ * allocation tags: blocks are labelled with the innermost tag the
+ * allocating thread pushed, a single thread-local read. names are
+ * interned into small ids on push, and live / total counts are kept per
+ * id under the lock. the table has a fixed size so reports can walk it
+ * as it is
+ */
+#ifndef LEAKED_MAX_TAGS
+#define LEAKED_MAX_TAGS 256
+#endif
+#ifndef LEAKED_TAG_DEPTH
+#define LEAKED_TAG_DEPTH 16
+#endif
+
+typedef struct
+{
+	const char* name;
+	size_t live;
+	size_t live_bytes;
+	size_t peak_bytes;
+	size_t allocs;
+	size_t alloc_bytes;
+#ifdef LEAKED_QUOTA
+	Quota quota;
+#endif
+} TagStat;
+
+typedef struct
+{
+	uint16_t cur; /* innermost tag */
+	uint16_t id[LEAKED_TAG_DEPTH];
+	uint32_t n; /* pushes, deeper ones are counted but not kept */
+} TagStack;
+
+#ifdef LEAKED_IMPLEMENTATION
+static TagStat _tags[LEAKED_MAX_TAGS] = { { "untagged",
+											 0,
+											 0,
+											 0,
+											 0,
+											 0
+#ifdef LEAKED_QUOTA
+											 ,
+											 { 0, 0, 0 }
+#endif
+										   } };
+static uint32_t _ntags = 1;
+static LEAKED_TLS TagStack _tagstk;
+#else
+extern TagStat _tags[LEAKED_MAX_TAGS];
+extern uint32_t _ntags;
+extern LEAKED_TLS TagStack _tagstk;
+#endif
+
+/* id of a tag name, interned when `add` is set. 0 if unknown or full */
+static uint16_t _tag_find(const char* name, int add)
+{
+	uint32_t n = __atomic_load_n(&_ntags, __ATOMIC_ACQUIRE);
+	for (uint32_t i = 1; i < n; i++)
+		if (!strcmp(_tags[i].name, name)) return (uint16_t)i;
+	if (!add) return 0;
+	uint16_t id = 0;
+	LOCK();
+	for (uint32_t i = n; i < _ntags && !id; i++)
+		if (!strcmp(_tags[i].name, name)) id = (uint16_t)i;
+	if (!id && _ntags < LEAKED_MAX_TAGS && _ntags <= 0xffff) {
+		size_t len = strlen(name) + 1;
+		char* copy = (char*)malloc(len);
+		if (copy) {
+			memcpy(copy, name, len);
+			id = (uint16_t)_ntags;
+			_tags[id].name = copy;
+			__atomic_store_n(&_ntags, _ntags + 1, __ATOMIC_RELEASE);
+		}
+	}
+	UNLOCK();
+	return id;
+}
+
+static void _tag_push_id(uint16_t id)
+{
+	if (_tagstk.n < LEAKED_TAG_DEPTH) _tagstk.id[_tagstk.n] = id;
+	_tagstk.n++;
+	_tagstk.cur = id;
+}
+
+/* label this thread's allocations with `name` until the matching pop */
+static void leaked_tag_push(const char* name) __attribute__((unused));
+static void leaked_tag_push(const char* name)
+{
+	_tag_push_id(_tag_find(name, 1));
+}
+
+static void leaked_tag_pop(void) __attribute__((unused));
+static void leaked_tag_pop(void)
+{
+	if (!_tagstk.n) return;
+	uint32_t n = --_tagstk.n;
+	if (n > LEAKED_TAG_DEPTH) n = LEAKED_TAG_DEPTH;
+	_tagstk.cur = n ? _tagstk.id[n - 1] : 0;
+}
+
+static void _tag_alloc(const Blk* b)
+{
+	TagStat* t = &_tags[b->tag];
+	t->allocs++;
+	t->alloc_bytes += b->sz;
+	t->live++;
+	t->live_bytes += b->sz;
+	if (t->live_bytes > t->peak_bytes) t->peak_bytes = t->live_bytes;
+}
+
+static void _tag_free(const Blk* b)
+{
+	TagStat* t = &_tags[b->tag];
+	t->live--;
+	t->live_bytes -= b->sz;
+}
+
+/* move a live block to another tag, counted as allocated there. 0 on
+ * success, -1 when p isn't a tracked block */
+static int leaked_tag_block(const void* p, const char* name)
+  __attribute__((unused));
+static int leaked_tag_block(const void* p, const char* name)
+{
+	uint16_t id = _tag_find(name, 1);
+	int rc = -1;
+	LOCK();
+	for (Blk* b = mgr.table ? mgr.table[_hash_ptr((void*)p, mgr.capacity)]
+							: NULL;
+		 b;
+		 b = b->next) {
+		if (b->ptr != p) continue;
+		_tag_free(b);
+		_tags[b->tag].allocs--;
+		_tags[b->tag].alloc_bytes -= b->sz;
+		b->tag = id;
+		_tag_alloc(b);
+		rc = 0;
+		break;
+	}
+	UNLOCK();
+	return rc;
+}
+
+/* bytes a tag holds right now, and its blocks in `blocks` if given */
+static size_t leaked_tag_bytes(const char* name, size_t* blocks)
+  __attribute__((unused));
+static size_t leaked_tag_bytes(const char* name, size_t* blocks)
+{
+	uint16_t id = _tag_find(name, 0);
+	LOCK();
+	size_t n = id ? _tags[id].live : 0;
+	size_t bytes = id ? _tags[id].live_bytes : 0;
+	UNLOCK();
+	if (blocks) *blocks = n;
+	return bytes;
+}
+#endif
+
+#ifdef LEAKED_CONTEXTS
+/*
+ * per-context accounting: the context id a thread set (a request id, say)
+ * goes into every block it allocates, and live / peak bytes are kept per
+ * id in an open addressing table under the lock. an entry is dropped once
+ * its context ended and its last block is freed. the budget callback
+ * runs in the allocating thread, outside the lock, each time a context
+ * goes over the budget
+ */
+typedef void (*LeakedBudgetFn)(uint64_t ctx, size_t live_bytes, void* arg);
+
+typedef struct
+{
+	uint64_t id; /* 0 = empty slot */
+	size_t live;
+	size_t live_bytes;
+	size_t peak_bytes;
+	int ended;
+} Ctx;
+
+typedef struct
+{
+	Ctx* slot;
+	size_t cap; /* power of two */
+	size_t n;
+	size_t budget; /* bytes, 0 = none */
+	LeakedBudgetFn fn;
+	void* arg;
+} Ctxs;
+
+#ifdef LEAKED_IMPLEMENTATION
+static Ctxs ctxs;
+static LEAKED_TLS uint64_t _ctx_cur;
+#else
+extern Ctxs ctxs;
+extern LEAKED_TLS uint64_t _ctx_cur;
+#endif
+
+static size_t _ctx_hash(uint64_t id)
+{
+	return (size_t)((id * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+/* entry of a context, added when `add` is set. NULL if unknown or out of
+ * memory */
+static Ctx* _ctx_get(uint64_t id, int add)
+{
+	if (add && (ctxs.n + 1) * (size_t)LEAKED_LOAD_DEN >
+				 ctxs.cap * (size_t)LEAKED_LOAD_NUM) {
+		size_t cap = ctxs.cap ? ctxs.cap * 2 : 256;
+		Ctx* slot = (Ctx*)calloc(cap, sizeof(Ctx));
+		if (!slot) return NULL;
+		for (size_t i = 0; i < ctxs.cap; i++) {
+			if (!ctxs.slot[i].id) continue;
+			size_t k = _ctx_hash(ctxs.slot[i].id) & (cap - 1);
+			while (slot[k].id)
+				k = (k + 1) & (cap - 1);
+			slot[k] = ctxs.slot[i];
+		}
+		free(ctxs.slot);
+		ctxs.slot = slot;
+		ctxs.cap = cap;
+	}
+	if (!ctxs.cap) return NULL;
+	size_t k = _ctx_hash(id) & (ctxs.cap - 1);
+	for (; ctxs.slot[k].id; k = (k + 1) & (ctxs.cap - 1))
+		if (ctxs.slot[k].id == id) return &ctxs.slot[k];
+	if (!add) return NULL;
+	memset(&ctxs.slot[k], 0, sizeof(Ctx));
+	ctxs.slot[k].id = id;
+	ctxs.n++;
+	return &ctxs.slot[k];
+}
+
+/* remove an entry, moving later ones of its probe run back */
+static void _ctx_drop(Ctx* e)
+{
+	size_t mask = ctxs.cap - 1;
+	size_t i = (size_t)(e - ctxs.slot);
+	for (size_t j = (i + 1) & mask; ctxs.slot[j].id; j = (j + 1) & mask) {
+		size_t k = _ctx_hash(ctxs.slot[j].id) & mask;
+		/* j stays unless its home k lies cyclically outside (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+		ctxs.slot[i] = ctxs.slot[j];
+		i = j;
+	}
+	ctxs.slot[i].id = 0;
+	ctxs.n--;
+}
+
+/* the live bytes of b's context when b takes it over the budget, else 0 */
+static size_t _ctx_alloc(const Blk* b)
+{
+	Ctx* e = _ctx_get(b->ctx, 1);
+	if (!e) return 0;
+	size_t was = e->live_bytes;
+	e->live++;
+	e->live_bytes += b->sz;
+	if (e->live_bytes > e->peak_bytes) e->peak_bytes = e->live_bytes;
+	if (ctxs.budget && was <= ctxs.budget && e->live_bytes > ctxs.budget)
+		return e->live_bytes;
+	return 0;
+}
+
+static void _ctx_free(const Blk* b)
+{
+	Ctx* e = _ctx_get(b->ctx, 0);
+	if (!e) return;
+	e->live--;
+	e->live_bytes -= b->sz;
+	if (e->ended && !e->live) _ctx_drop(e);
+}
+
+/* make id (0 = none) this thread's context, returns the previous one */
+static uint64_t leaked_set_context(uint64_t id) __attribute__((unused));
+static uint64_t leaked_set_context(uint64_t id)
+{
+	uint64_t prev = _ctx_cur;
+	_ctx_cur = id;
+	return prev;
+}
+
+/* bytes a context holds now, and its peak in `peak` if given */
+static size_t leaked_context_bytes(uint64_t id, size_t* peak)
+  __attribute__((unused));
+static size_t leaked_context_bytes(uint64_t id, size_t* peak)
+{
+	LOCK();
+	const Ctx* e = id ? _ctx_get(id, 0) : NULL;
+	size_t live = e ? e->live_bytes : 0;
+	if (peak) *peak = e ? e->peak_bytes : 0;
+	UNLOCK();
+	return live;
+}
+
+/* no more allocations will be made under id: its entry goes away with
+ * its last block. returns its peak bytes */
+static size_t leaked_context_end(uint64_t id) __attribute__((unused));
+static size_t leaked_context_end(uint64_t id)
+{
+	LOCK();
+	Ctx* e = id ? _ctx_get(id, 0) : NULL;
+	size_t peak = e ? e->peak_bytes : 0;
+	if (e && !e->live)
+		_ctx_drop(e);
+	else if (e)
+		e->ended = 1;
+	UNLOCK();
+	return peak;
+}
+
+/* call fn whenever a context goes over `bytes` live, 0 turns it off */
+static void leaked_set_budget(size_t bytes, LeakedBudgetFn fn, void* arg)
+  __attribute__((unused));
+static void leaked_set_budget(size_t bytes, LeakedBudgetFn fn, void* arg)
+{
+	LOCK();
+	ctxs.budget = fn ? bytes : 0;
+	ctxs.fn = fn;
+	ctxs.arg = arg;
+	UNLOCK();
+}
+#endif
+
+#ifdef LEAKED_QUOTA
+/*
+ * quotas: a global byte limit and one per tag, checked by the wrappers
+ * before libc is asked for memory. the global count is kept per thread
+ * and folded into a shared total every LEAKED_QUOTA_BATCH bytes (and at
+ * thread exit), so it can be off by a batch per thread. tag counts are
+ * the exact ones kept under the lock, read without it. either way the
+ * limits are soft under concurrent allocation
+ */
+#define LEAKED_QUOTA_LOG 1	/* say so on stderr, once per quota */
+#define LEAKED_QUOTA_FAIL 2 /* the allocation returns NULL */
+#define LEAKED_QUOTA_CALL 4 /* call the leaked_set_quota_handler() fn */
+#ifndef LEAKED_QUOTA_BATCH
+#define LEAKED_QUOTA_BATCH ((int64_t)64 << 10)
+#endif
+
+/* quota name ("global" or the tag), its limit, the bytes it holds and
+ * the bytes asked for */
+typedef void (*LeakedQuotaFn)(
+  const char* name, size_t limit, size_t live, size_t n, void* arg);
+
+typedef struct
+{
+	Quota all;
+	int64_t live; /* folded per-thread counts */
+	LeakedQuotaFn fn;
+	void* arg;
+} Quotas;
+
+typedef struct
+{
+	int64_t delta; /* not folded into quotas.live yet */
+	int busy;	   /* in the handler */
+	int reg;	   /* flushed at thread exit */
+} QuotaTls;
+
+#ifdef LEAKED_IMPLEMENTATION
+static Quotas quotas;
+static LEAKED_TLS QuotaTls _quota;
+#else
+extern Quotas quotas;
+extern LEAKED_TLS QuotaTls _quota;
+#endif
+
+static void _quota_flush(void)
+{
+	__atomic_add_fetch(&quotas.live, _quota.delta, __ATOMIC_RELAXED);
+	_quota.delta = 0;
+}
+
+#ifdef LEAKED_THREAD_SAFE
+static pthread_key_t _quota_key;
+static pthread_once_t _quota_once = PTHREAD_ONCE_INIT;
+
+static void _quota_exit(void* arg)
+{
+	(void)arg;
+	_quota_flush();
+}
+
+static void _quota_key_init(void)
+{
+	pthread_key_create(&_quota_key, _quota_exit);
+}
+#endif
+
+/* count bytes allocated (d > 0) or freed by this thread */
+static void _quota_count(int64_t d)
+{
+#ifdef LEAKED_THREAD_SAFE
+	if (!_quota.reg) {
+		_quota.reg = 1;
+		pthread_once(&_quota_once, _quota_key_init);
+		pthread_setspecific(_quota_key, &_quota);
+	}
+#endif
+	_quota.delta += d;
+	if (_quota.delta >= LEAKED_QUOTA_BATCH ||
+		_quota.delta <= -LEAKED_QUOTA_BATCH)
+		_quota_flush();
+}
+
+/* an allocation would cross q, 1 if it must fail */
+static int _quota_hit(Quota* q, const char* name, size_t live, size_t n)
+{
+	int action = __atomic_load_n(&q->action, __ATOMIC_RELAXED);
+	if ((action & LEAKED_QUOTA_LOG) &&
+		!__atomic_exchange_n(&q->logged, 1, __ATOMIC_RELAXED))
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " quota %s of %lu bytes crossed, %lu "
+					"live + %lu\n",
+				name,
+				(unsigned long)q->limit,
+				(unsigned long)live,
+				(unsigned long)n);
+	LeakedQuotaFn fn = __atomic_load_n(&quotas.fn, __ATOMIC_ACQUIRE);
+	if ((action & LEAKED_QUOTA_CALL) && fn && !_quota.busy) {
+		/* allocations made by the handler don't call it again */
+		_quota.busy = 1;
+		fn(name, q->limit, live, n, quotas.arg);
+		_quota.busy = 0;
+	}
+	return (action & LEAKED_QUOTA_FAIL) != 0;
+}
+
+/* may a block grow from `old` to `n` bytes under `tag`? 0 if so */
+static int _quota_admit(size_t n, size_t old, unsigned tag)
+{
+	if (n <= old) return 0;
+	int fail = 0;
+	size_t lim = __atomic_load_n(&quotas.all.limit, __ATOMIC_RELAXED);
+	if (lim) {
+		int64_t v = __atomic_load_n(&quotas.live, __ATOMIC_RELAXED);
+		size_t live = v + _quota.delta > 0 ? (size_t)(v + _quota.delta) : 0;
+		if (live + (n - old) > lim)
+			fail |= _quota_hit(&quotas.all, "global", live, n - old);
+	}
+#ifdef LEAKED_TAGS
+	TagStat* t = &_tags[tag];
+	lim = __atomic_load_n(&t->quota.limit, __ATOMIC_RELAXED);
+	if (lim) {
+		size_t live = __atomic_load_n(&t->live_bytes, __ATOMIC_RELAXED);
+		if (live + (n - old) > lim)
+			fail |= _quota_hit(&t->quota, t->name, live, n - old);
+	}
+#else
+	(void)tag;
+#endif
+	return fail;
+}
+
+/* limit the bytes live under a tag (NULL for all of them) to `bytes`, 0
+ * removes the limit. `action` is LEAKED_QUOTA_LOG, _FAIL and/or _CALL.
+ * 0 on success */
+static int leaked_set_quota(const char* tag, size_t bytes, int action)
+  __attribute__((unused));
+static int leaked_set_quota(const char* tag, size_t bytes, int action)
+{
+	Quota* q = &quotas.all;
+	if (tag) {
+#ifdef LEAKED_TAGS
+		uint16_t id = _tag_find(tag, 1);
+		if (!id) return -1;
+		q = &_tags[id].quota;
+#else
+		return -1;
+#endif
+	}
+	__atomic_store_n(&q->action, action, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->logged, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->limit, bytes, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void leaked_set_quota_handler(LeakedQuotaFn fn, void* arg)
+  __attribute__((unused));
+static void leaked_set_quota_handler(LeakedQuotaFn fn, void* arg)
+{
+	quotas.arg = arg;
+	__atomic_store_n(&quotas.fn, fn, __ATOMIC_RELEASE);
+}
+
+#ifdef LEAKED_TAGS
+#define LEAKED_QUOTA_TAG _tagstk.cur
+#else
+#define LEAKED_QUOTA_TAG 0u
+#endif
+
+/* growing old to n bytes, checked before anything is allocated or old
+ * leaves the counts, so only the growth is weighed and a refusal leaves
+ * old as it was. 1 if a quota turns it down */
+static int _quota_realloc(void* old, size_t n)
+{
+	size_t sz = 0;
+	unsigned tag = LEAKED_QUOTA_TAG;
+	LOCK();
+	for (Blk* b = old && mgr.table ? mgr.table[_hash_ptr(old, mgr.capacity)]
+								   : NULL;
+		 b;
+		 b = b->next) {
+		if (b->ptr != old) continue;
+		sz = b->sz;
+#ifdef LEAKED_TAGS
+		tag = b->tag;
+#endif
+		break;
+	}
+	UNLOCK();
+	return _quota_admit(n, sz, tag);
+}
+#endif
+
+#ifdef LEAKED_SLACK
+/*
+ * usable size: asked of whatever malloc the process ended up with, so an
+ * allocator loaded with LD_PRELOAD answers for its own blocks. the
+ * symbol is weak and bound under its own name, which neither needs
+ * <malloc.h> nor clashes with it. when nothing defines it the size is
+ * guessed the way glibc rounds: 16-byte chunks of at least 32 bytes, 8 of
+ * them header. blocks behind guard pages are guessed too, as are blocks
+ * with redzones, which the allocator only ever sees padded
+ */
+extern size_t _leaked_usable_size(void* p) __asm__("malloc_usable_size")
+  __attribute__((weak));
+
+static uint32_t _slack(void* p, size_t n)
+{
+	size_t u;
+	if (_leaked_usable_size && !LEAKED_RZ && !LEAKED_GUARDED(n))
+		u = _leaked_usable_size(p);
+	else {
+		u = (n + 8 + 15) & ~(size_t)15;
+		u = (u < 32 ? 32 : u) - 8;
+	}
+	u = u > n ? u - n : 0;
+	return u > UINT32_MAX ? UINT32_MAX : (uint32_t)u;
+}
+#endif
+
+#if defined(LEAKED_REACHABILITY) && defined(LEAKED_THREAD_SAFE)
+/*
+ * threads that allocated, for the reachability scan: the stack range
+ * pthread_getattr_np reports (with glibc that block also holds the
+ * thread's static TLS), in a record that lives in the thread's own
+ * static TLS, so its address also finds the TLS of the main thread. it
+ * is unlinked by a key destructor when the thread exits
+ */
+typedef struct ReachThread
+{
+	const unsigned char* lo; /* stack */
+	const unsigned char* hi;
+	struct ReachThread* prev;
+	struct ReachThread* next;
+	int reg;
+} ReachThread;
+
+#ifdef LEAKED_IMPLEMENTATION
+static ReachThread* _rthreads;
+static LEAKED_TLS ReachThread _rthr;
+#else
+extern ReachThread* _rthreads;
+extern LEAKED_TLS ReachThread _rthr;
+#endif
+
+static pthread_key_t _rthr_key;
+static pthread_once_t _rthr_once = PTHREAD_ONCE_INIT;
+
+static void _rthr_exit(void* arg)
+{
+	ReachThread* t = (ReachThread*)arg;
+	LOCK();
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		_rthreads = t->next;
+	if (t->next) t->next->prev = t->prev;
+	UNLOCK();
+}
+
+static void _rthr_key_init(void)
+{
+	pthread_key_create(&_rthr_key, _rthr_exit);
+}
+
+static void _rthr_register(void)
+{
+	_rthr.reg = 1;
+	if (!_thread_stack(&_rthr.lo, &_rthr.hi)) return;
+	pthread_once(&_rthr_once, _rthr_key_init);
+	pthread_setspecific(_rthr_key, &_rthr);
+	LOCK();
+	_rthr.prev = NULL;
+	_rthr.next = _rthreads;
+	if (_rthreads) _rthreads->prev = &_rthr;
+	_rthreads = &_rthr;
+	UNLOCK();
+}
+#endif
+
+/* hang a filled in block on the table, under the lock */
+static void _link_blk(Blk* b)
+{
+	unsigned int idx = _hash_ptr(b->ptr, mgr.capacity);
+	b->next = mgr.table[idx];
+	mgr.table[idx] = b;
+	mgr.alive++;
+#ifdef LEAKED_ADDR_INDEX
+	_idx_insert(&mgr.root, b);
+#endif
+#ifdef LEAKED_SHADOW
+	_shadow_set(b->ptr);
+#endif
+}
+
+/* add block to the table */
+static LEAKED_NOINLINE void _add_blk(void* p,
+									  size_t sz,
+									  Site at,
+									  uint32_t stack)
+{
+	if (!p) return;
+#if defined(LEAKED_REACHABILITY) && defined(LEAKED_THREAD_SAFE)
+	if (!_rthr.reg) _rthr_register();
+#endif
+#ifdef LEAKED_SLACK
+	uint32_t slack = _slack(p, sz);
+#endif
+#ifndef LEAKED_STACK_DEPTH
+	(void)stack;
+#endif
+#ifdef LEAKED_TAGS
+	uint16_t tag = _tagstk.cur;
+#endif
+#ifdef LEAKED_CONTEXTS
+	uint64_t ctx = _ctx_cur;
+	size_t over = 0;
+	LeakedBudgetFn fn = NULL;
+	void* arg = NULL;
+#endif
+	LOCK();
+#ifdef LEAKED_TRACE
+	tbuf.stamp = _trace_stamp();
+#endif
+	_ensure_table_ext();
+	_maybe_resize();
+	Blk* b = (Blk*)malloc(sizeof(Blk));
+	if (b) {
+		b->ptr = p;
+		b->sz = sz;
+		b->at = at;
+#ifdef LEAKED_STACK_DEPTH
+		b->stack = stack;
+#endif
+#ifdef LEAKED_SLACK
+		b->slack = slack;
+#endif
+#ifdef LEAKED_SITE_STATS
+		_stat_alloc(b);
+#endif
+#ifdef LEAKED_TAGS
+		b->tag = tag;
+		_tag_alloc(b);
+#endif
+#ifdef LEAKED_CONTEXTS
+		b->ctx = ctx;
+		if (ctx && (over = _ctx_alloc(b))) {
+			fn = ctxs.fn;
+			arg = ctxs.arg;
+		}
+#endif
+		_link_blk(b);
+	}
+	UNLOCK();
+#ifdef LEAKED_CONTEXTS
+	if (over && fn) fn(ctx, over, arg);
+#endif
+#ifdef LEAKED_QUOTA
+	if (b) _quota_count((int64_t)sz);
+#endif
+}
+
+#ifndef LEAKED_SLOW_FREE
+/* put back a block _del_blk took out, for a realloc that failed. it keeps
+ * its stack, site entry, tag and context, nothing counts it as a new
+ * allocation */
+static void _readd_blk(const Blk* ob)
+{
+	LOCK();
+#ifdef LEAKED_TRACE
+	tbuf.stamp = _trace_stamp();
+#endif
+	_ensure_table_ext();
+	_maybe_resize();
+	Blk* b = (Blk*)malloc(sizeof(Blk));
+	if (b) {
+		*b = *ob;
+#ifdef LEAKED_SITE_STATS
+		_stat_readd(b);
+#endif
+#ifdef LEAKED_TAGS
+		_tag_alloc(b);
+		_tags[b->tag].allocs--;
+		_tags[b->tag].alloc_bytes -= b->sz;
+#endif
+#ifdef LEAKED_CONTEXTS
+		if (b->ctx) _ctx_alloc(b);
+#endif
+		_link_blk(b);
+	}
+	UNLOCK();
+#ifdef LEAKED_QUOTA
+	if (b) _quota_count((int64_t)ob->sz);
+#endif
+}
+#endif
+
+/* remove block, (if) report invalid frees. a copy of the removed block
+ * is stored in `out` when given */
+static int _del_blk(void* p, Site at, Blk* out)
+{
+	if (!p) return 0;
+	int ok = 0;
+#ifdef LEAKED_QUOTA
+	size_t freed = 0;
+#endif
+#ifdef LEAKED_SHADOW
+	/* pointers that start no block are turned away without the lock */
+	if (!_shadow_test(p)) goto invalid;
+#endif
+	LOCK();
+	if (mgr.table) {
+		unsigned int idx = _hash_ptr(p, mgr.capacity);
+		Blk** pp;
+		for (pp = &mgr.table[idx]; *pp; pp = &(*pp)->next) {
+			if ((*pp)->ptr == p) {
+				Blk* tmp = *pp;
+				*pp = tmp->next;
+#ifdef LEAKED_ADDR_INDEX
+				_idx_remove(&mgr.root, tmp);
+#endif
+#ifdef LEAKED_SHADOW
+				_shadow_clear(p);
+#endif
+#ifdef LEAKED_SITE_STATS
+				_stat_free(tmp);
+#endif
+#ifdef LEAKED_TAGS
+				_tag_free(tmp);
+#endif
+#ifdef LEAKED_CONTEXTS
+				if (tmp->ctx) _ctx_free(tmp);
+#endif
+#ifdef LEAKED_QUOTA
+				freed = tmp->sz;
+#endif
+				if (out) *out = *tmp;
+				free(tmp);
+				mgr.alive--;
+				ok = 1;
+#ifdef LEAKED_TRACE
+				tbuf.stamp = _trace_stamp();
+#endif
+				break;
+			}
+		}
+	}
+	UNLOCK();
+#ifdef LEAKED_QUOTA
+	if (ok) _quota_count(-(int64_t)freed);
+#endif
+#ifdef LEAKED_SHADOW
+invalid:
+#endif
+	if (!ok)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " invalid free at %p (" SITE_FMT ")\n",
+				p,
+				SITE_ARG(at));
+	return ok;
+}
+
+/* index of the first byte in p[0..n) that is not c, or n if all match */
+static size_t
+_scan_byte_scalar(const unsigned char* p, size_t n, unsigned char c)
+{
+	for (size_t i = 0; i < n; i++)
+		if (p[i] != c) return i;
+	return n;
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+static size_t _scan_byte_sse2(const unsigned char* p, size_t n, unsigned char c)
+{
+	__m128i v = _mm_set1_epi8((char)c);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+		unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, v));
+		if (m != 0xffffu) return i + (size_t)__builtin_ctz(~m & 0xffffu);
+	}
+	return i + _scan_byte_scalar(p + i, n - i, c);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define LEAKED_HAVE_AVX2 1
+__attribute__((target("avx2"))) static size_t
+_scan_byte_avx2(const unsigned char* p, size_t n, unsigned char c)
+{
+	__m256i v = _mm256_set1_epi8((char)c);
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+		unsigned int m =
+		  (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v));
+		if (m != 0xffffffffu) return i + (size_t)__builtin_ctz(~m);
+	}
+	return i + _scan_byte_sse2(p + i, n - i, c);
+}
+#endif
+
+/* pick the widest compare the cpu has, once */
+static size_t _scan_byte(const unsigned char* p, size_t n, unsigned char c)
+  __attribute__((unused));
+static size_t _scan_byte(const unsigned char* p, size_t n, unsigned char c)
+{
+#ifdef LEAKED_HAVE_AVX2
+	static int avx2 = -1;
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	if (avx2) return _scan_byte_avx2(p, n, c);
+#endif
+#if defined(__SSE2__)
+	return _scan_byte_sse2(p, n, c);
+#else
+	return _scan_byte_scalar(p, n, c);
+#endif
+}
+
+/* memset that uses non-temporal stores for big blocks, so scrubbing a
+ * multi-megabyte buffer doesn't evict the caller's working set */
+static void _fill(void* p, int c, size_t n)
+{
+#if defined(__SSE2__)
+	if (n >= LEAKED_NT_THRESHOLD) {
+		unsigned char* d = (unsigned char*)p;
+		size_t head = (size_t)(-(uintptr_t)d & 15);
+		memset(d, c, head);
+		d += head;
+		n -= head;
+		__m128i v = _mm_set1_epi8((char)c);
+		for (; n >= 64; n -= 64, d += 64) {
+			_mm_stream_si128((__m128i*)d, v);
+			_mm_stream_si128((__m128i*)(d + 16), v);
+			_mm_stream_si128((__m128i*)(d + 32), v);
+			_mm_stream_si128((__m128i*)(d + 48), v);
+		}
+		_mm_sfence();
+		memset(d, c, n);
+		return;
+	}
+#endif
+	memset(p, c, n);
+}
+
+/* apply the runtime fill modes, bounded by mgr.fill_cap */
+static void _junk(void* p, size_t n)
+{
+	int c = mgr.alloc_fill;
+	if (c >= 0) _fill(p, c, n < mgr.fill_cap ? n : mgr.fill_cap);
+}
+
+static void _scrub(void* p, size_t n)
+{
+	int c = mgr.free_fill;
+	if (c >= 0) _fill(p, c, n < mgr.fill_cap ? n : mgr.fill_cap);
+}
+
+/* change fill modes at runtime. a byte of -1 turns that fill off, `cap`
+ * bounds how many bytes of each block are filled */
+static void leaked_set_fill(int alloc_byte, int free_byte, size_t cap)
+  __attribute__((unused));
+static void leaked_set_fill(int alloc_byte, int free_byte, size_t cap)
+{
+	LOCK();
+	mgr.alloc_fill = alloc_byte < 0 ? -1 : (alloc_byte & 0xff);
+	mgr.free_fill = free_byte < 0 ? -1 : (free_byte & 0xff);
+	mgr.fill_cap = cap;
+	UNLOCK();
+}
+
+#ifdef LEAKED_GUARD_PAGES
+/*
+ * guard pages: big blocks get a mapping of their own, laid out as
+ * [slack][user bytes][PROT_NONE page] (or [PROT_NONE page][user bytes][slack]
+ * with LEAKED_GUARD_BEFORE), the user region is LEAKED_GUARD_ALIGN-aligned
+ * and touches the guard page. the bytes between the end of the block and
+ * the page it can't reach without faulting are filled with
+ * LEAKED_REDZONE_BYTE and checked on free. the geometry only depends on
+ * the size, so freed mappings go to a small cache and are reused by blocks
+ * spanning the same pages.
+ */
+static size_t _page_size(void)
+{
+	static size_t ps = 0;
+	if (!ps) ps = (size_t)sysconf(_SC_PAGESIZE);
+	return ps;
+}
+
+/* an n-byte block rounded up to the alignment */
+static size_t _gp_span(size_t n)
+{
+	return (n + (size_t)(LEAKED_GUARD_ALIGN)-1) &
+		   ~((size_t)(LEAKED_GUARD_ALIGN)-1);
+}
+
+/* whole mapping length for an n-byte block */
+static size_t _gp_len(size_t n)
+{
+	size_t ps = _page_size();
+	return (_gp_span(n) + ps - 1) / ps * ps + ps;
+}
+
+/* bytes past the end of an n-byte block that don't fault */
+static size_t _gp_tail(size_t n)
+{
+#ifdef LEAKED_GUARD_BEFORE
+	return _gp_len(n) - _page_size() - n;
+#else
+	return _gp_span(n) - n;
+#endif
+}
+
+/* where the user region starts inside a mapping */
+static unsigned char* _gp_user(unsigned char* map, size_t n)
+{
+#ifdef LEAKED_GUARD_BEFORE
+	(void)n;
+	return map + _page_size();
+#else
+	return map + _gp_len(n) - _page_size() - _gp_span(n);
+#endif
+}
+
+static unsigned char* _gp_map(const unsigned char* p, size_t n)
+{
+#ifdef LEAKED_GUARD_BEFORE
+	(void)n;
+	return (unsigned char*)p - _page_size();
+#else
+	return (unsigned char*)p + _gp_span(n) + _page_size() - _gp_len(n);
+#endif
+}
+
+static void* _gp_alloc(size_t n, int zero)
+{
+	if (n > ((size_t)-1) / 2) return NULL;
+	size_t len = _gp_len(n);
+	unsigned char* map = NULL;
+	LOCK();
+	for (size_t i = 0; i < mgr.gp_n; i++) {
+		if (mgr.gp_len[i] == len) {
+			map = (unsigned char*)mgr.gp_cache[i];
+			mgr.gp_n--;
+			mgr.gp_cache[i] = mgr.gp_cache[mgr.gp_n];
+			mgr.gp_len[i] = mgr.gp_len[mgr.gp_n];
+			break;
+		}
+	}
+	UNLOCK();
+	if (map) {
+		if (zero) memset(_gp_user(map, n), 0, n);
+	} else {
+		map = (unsigned char*)mmap(NULL,
+								   len,
+								   PROT_READ | PROT_WRITE,
+								   MAP_PRIVATE | MAP_ANONYMOUS,
+								   -1,
+								   0);
+		if (map == (unsigned char*)MAP_FAILED) return NULL;
+#ifdef LEAKED_GUARD_BEFORE
+		mprotect(map, _page_size(), PROT_NONE);
+#else
+		mprotect(map + len - _page_size(), _page_size(), PROT_NONE);
+#endif
+	}
+	unsigned char* u = _gp_user(map, n);
+	memset(u + n, LEAKED_REDZONE_BYTE, _gp_tail(n));
+	return u;
+}
+
+static void _gp_free(void* p, size_t n)
+{
+	unsigned char* map = _gp_map((unsigned char*)p, n);
+	size_t len = _gp_len(n);
+	LOCK();
+	if (mgr.gp_n < (size_t)LEAKED_GUARD_CACHE) {
+		mgr.gp_cache[mgr.gp_n] = map;
+		mgr.gp_len[mgr.gp_n] = len;
+		mgr.gp_n++;
+		map = NULL;
+	}
+	UNLOCK();
+	if (map) munmap(map, len);
+}
+
+/* verify the filled slack past a guarded block, reports the first bad byte
+ * as an offset from the user pointer. `at` is the site that noticed, NULL
+ * when found by a scan. returns 1 if intact */
+static int _gp_check(const Blk* b, const Site* at)
+{
+	const unsigned char* u = (const unsigned char*)b->ptr;
+	size_t tail = _gp_tail(b->sz);
+	size_t i = _scan_byte(u + b->sz, tail, LEAKED_REDZONE_BYTE);
+	if (i == tail) return 1;
+	if (at)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET
+					" guard slack corrupted at offset %lu of %lu-byte block "
+					"%p (" SITE_FMT "), freed at (" SITE_FMT ")\n",
+				(unsigned long)(b->sz + i),
+				(unsigned long)b->sz,
+				b->ptr,
+				SITE_ARG(b->at),
+				SITE_ARG(*at));
+	else
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET
+					" guard slack corrupted at offset %lu of %lu-byte block "
+					"%p (" SITE_FMT ")\n",
+				(unsigned long)(b->sz + i),
+				(unsigned long)b->sz,
+				b->ptr,
+				SITE_ARG(b->at));
+	return 0;
+}
+#endif
+
+/*
+ * raw allocation layer: with LEAKED_REDZONE every block is laid out as
+ * [redzone][user bytes][redzone], both zones filled with LEAKED_REDZONE_BYTE.
+ * blocks served from guard pages have no redzones.
+ * the table only ever sees the user pointer.
+ */
+static void* _raw_malloc(size_t n, int zero)
+{
+#ifdef LEAKED_GUARD_PAGES
+	if (LEAKED_GUARDED(n)) return _gp_alloc(n, zero);
+#endif
+#ifdef LEAKED_REDZONE
+	if (n > ((size_t)-1) - 2 * LEAKED_RZ) return NULL;
+	unsigned char* b =
+	  (unsigned char*)(zero ? calloc(1, n + 2 * LEAKED_RZ)
+							: malloc(n + 2 * LEAKED_RZ));
+	if (!b) return NULL;
+	memset(b, LEAKED_REDZONE_BYTE, LEAKED_RZ);
+	memset(b + LEAKED_RZ + n, LEAKED_REDZONE_BYTE, LEAKED_RZ);
+	return b + LEAKED_RZ;
+#else
+	return zero ? calloc(1, n) : malloc(n);
+#endif
+}
+
+static void _raw_free(void* p, size_t n)
+{
+#ifdef LEAKED_GUARD_PAGES
+	if (LEAKED_GUARDED(n)) {
+		_gp_free(p, n);
+		return;
+	}
+#endif
+	(void)n;
+	free((unsigned char*)p - LEAKED_RZ);
+}
+
+#ifdef LEAKED_REDZONE
+/* verify both redzones of a block. reports the first bad byte as an offset
+ * from the user pointer (negative = underflow). `at` is the site that
+ * noticed, NULL when found by a scan. returns 1 if intact */
+static int _rz_check(const Blk* b, const Site* at)
+{
+	const unsigned char* u = (const unsigned char*)b->ptr;
+	const unsigned char* base = u - LEAKED_RZ;
+	long off;
+#ifdef LEAKED_GUARD_PAGES
+	if (LEAKED_GUARDED(b->sz)) return _gp_check(b, at);
+#endif
+	size_t i = _scan_byte(base, LEAKED_RZ, LEAKED_REDZONE_BYTE);
+	if (i < LEAKED_RZ)
+		off = (long)i - (long)LEAKED_RZ;
+	else {
+		i = _scan_byte(u + b->sz, LEAKED_RZ, LEAKED_REDZONE_BYTE);
+		if (i == LEAKED_RZ) return 1;
+		off = (long)(b->sz + i);
+	}
+	if (at)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET
+					" redzone corrupted at offset %ld of %lu-byte block %p "
+					"(" SITE_FMT "), freed at (" SITE_FMT ")\n",
+				off,
+				(unsigned long)b->sz,
+				b->ptr,
+				SITE_ARG(b->at),
+				SITE_ARG(*at));
+	else
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET
+					" redzone corrupted at offset %ld of %lu-byte block %p "
+					"(" SITE_FMT ")\n",
+				off,
+				(unsigned long)b->sz,
+				b->ptr,
+				SITE_ARG(b->at));
+	return 0;
+}
+
+typedef struct
+{
+	size_t from, to;
+	size_t bad;
+} RzScan;
+
+static void* _rz_scan_range(void* arg)
+{
+	RzScan* s = (RzScan*)arg;
+	for (size_t i = s->from; i < s->to; i++)
+		for (Blk* b = mgr.table[i]; b; b = b->next)
+			if (!_rz_check(b, NULL)) s->bad++;
+	return NULL;
+}
+
+/* check every live block's redzones, returns the number of corrupted ones.
+ * with LEAKED_THREAD_SAFE the buckets are split over LEAKED_SCAN_THREADS */
+static size_t leaked_check_redzones(void) __attribute__((unused));
+static size_t leaked_check_redzones(void)
+{
+	size_t bad = 0;
+	LOCK();
+	if (mgr.table) {
+#ifdef LEAKED_THREAD_SAFE
+		enum { N = LEAKED_SCAN_THREADS > 1 ? LEAKED_SCAN_THREADS : 1 };
+		RzScan part[N];
+		pthread_t th[N];
+		int started[N];
+		for (size_t t = 0; t < (size_t)N; t++) {
+			part[t].from = mgr.capacity * t / N;
+			part[t].to = mgr.capacity * (t + 1) / N;
+			part[t].bad = 0;
+			started[t] = t > 0 && pthread_create(&th[t],
+												 NULL,
+												 _rz_scan_range,
+												 &part[t]) == 0;
+			if (t > 0 && !started[t]) _rz_scan_range(&part[t]);
+		}
+		_rz_scan_range(&part[0]);
+		for (size_t t = 0; t < (size_t)N; t++) {
+			if (started[t]) pthread_join(th[t], NULL);
+			bad += part[t].bad;
+		}
+#else
+		RzScan all = { 0, mgr.capacity, 0 };
+		_rz_scan_range(&all);
+		bad = all.bad;
+#endif
+	}
+	UNLOCK();
+	return bad;
+}
+#endif
+
+#ifdef LEAKED_QUARANTINE
+/*
+ * quarantine: freed blocks are poisoned with LEAKED_FREE_BYTE and parked in
+ * a per-thread FIFO instead of going back to libc. once a thread holds more
+ * than LEAKED_QUARANTINE bytes the oldest blocks are evicted in a batch
+ * (down to 3/4 of the budget), checked for writes after free and released.
+ * no lock is taken, each thread only touches its own ring.
+ */
+typedef struct
+{
+	void* ptr;
+	size_t sz;
+	Site at; /* allocated at */
+	Site freed_at;
+} QEnt;
+
+typedef struct
+{
+	QEnt* ring;
+	size_t cap;
+	size_t head;
+	size_t len;
+	size_t bytes;
+} Quar;
+
+#ifdef LEAKED_IMPLEMENTATION
+static LEAKED_TLS Quar quar;
+#else
+extern LEAKED_TLS Quar quar;
+#endif
+
+/* verify a block leaving the quarantine and hand it back to libc */
+static void _quar_release(const QEnt* e)
+{
+	const unsigned char* u = (const unsigned char*)e->ptr;
+	size_t i = _scan_byte(u, e->sz, LEAKED_FREE_BYTE);
+	if (i < e->sz)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET
+					" write after free at offset %lu of %lu-byte block %p "
+					"(" SITE_FMT "), freed at (" SITE_FMT ")\n",
+				(unsigned long)i,
+				(unsigned long)e->sz,
+				e->ptr,
+				SITE_ARG(e->at),
+				SITE_ARG(e->freed_at));
+#ifdef LEAKED_REDZONE
+	Blk b;
+	b.ptr = e->ptr;
+	b.sz = e->sz;
+	b.at = e->at;
+	_rz_check(&b, &e->freed_at);
+#endif
+	_raw_free(e->ptr, e->sz);
+}
+
+/* evict oldest blocks until at most `keep` bytes are held */
+static void _quar_evict(size_t keep)
+{
+	while (quar.len && quar.bytes > keep) {
+		QEnt e = quar.ring[quar.head];
+		quar.head = (quar.head + 1) % quar.cap;
+		quar.len--;
+		quar.bytes -= e.sz;
+		_quar_release(&e);
+	}
+}
+
+#ifdef LEAKED_THREAD_SAFE
+static pthread_key_t _quar_key;
+static pthread_once_t _quar_once = PTHREAD_ONCE_INIT;
+
+/* drain a thread's quarantine when it exits */
+static void _quar_exit(void* arg)
+{
+	(void)arg;
+	_quar_evict(0);
+	free(quar.ring);
+	memset(&quar, 0, sizeof(quar));
+}
+
+static void _quar_key_init(void)
+{
+	pthread_key_create(&_quar_key, _quar_exit);
+}
+#endif
+
+/* grow the ring, keeping FIFO order */
+static int _quar_grow(void)
+{
+	size_t ncap = quar.cap ? quar.cap * 2 : 256;
+	QEnt* r = (QEnt*)malloc(ncap * sizeof(QEnt));
+	if (!r) return 0;
+	for (size_t i = 0; i < quar.len; i++)
+		r[i] = quar.ring[(quar.head + i) % quar.cap];
+	free(quar.ring);
+#ifdef LEAKED_THREAD_SAFE
+	if (!quar.ring) {
+		pthread_once(&_quar_once, _quar_key_init);
+		pthread_setspecific(_quar_key, &quar);
+	}
+#endif
+	quar.ring = r;
+	quar.cap = ncap;
+	quar.head = 0;
+	return 1;
+}
+
+/* poison and park a freed block, returns 0 if it doesn't fit (bigger than
+ * the whole budget) and must be released right away */
+static int _quar_push(const Blk* b, Site at)
+{
+	if (b->sz > (size_t)(LEAKED_QUARANTINE) ||
+		(quar.len == quar.cap && !_quar_grow()))
+		return 0;
+	_fill(b->ptr, LEAKED_FREE_BYTE, b->sz);
+#ifdef LEAKED_REDZONE
+	/* free already reported any damage, repaint the zones so leaving the
+	 * quarantine only reports what was written since */
+	unsigned char* u = (unsigned char*)b->ptr;
+#ifdef LEAKED_GUARD_PAGES
+	if (LEAKED_GUARDED(b->sz))
+		memset(u + b->sz, LEAKED_REDZONE_BYTE, _gp_tail(b->sz));
+	else
+#endif
+	{
+		memset(u - LEAKED_RZ, LEAKED_REDZONE_BYTE, LEAKED_RZ);
+		memset(u + b->sz, LEAKED_REDZONE_BYTE, LEAKED_RZ);
+	}
+#endif
+	QEnt* e = &quar.ring[(quar.head + quar.len) % quar.cap];
+	e->ptr = b->ptr;
+	e->sz = b->sz;
+	e->at = b->at;
+	e->freed_at = at;
+	quar.len++;
+	quar.bytes += b->sz;
+	if (quar.bytes > (size_t)(LEAKED_QUARANTINE))
+		_quar_evict((size_t)(LEAKED_QUARANTINE) / 4 * 3);
+	return 1;
+}
+#endif
+
+/* release a block that was just removed from the table */
+static void _release(const Blk* b, Site at)
+{
+	(void)at;
+#ifdef LEAKED_REDZONE
+	_rz_check(b, &at);
+#elif defined(LEAKED_GUARD_PAGES)
+	if (LEAKED_GUARDED(b->sz)) _gp_check(b, &at);
+#endif
+#ifdef LEAKED_QUARANTINE
+	if (_quar_push(b, at)) return;
+#endif
+	_scrub(b->ptr, b->sz);
+	_raw_free(b->ptr, b->sz);
+}
+
+static LEAKED_NOINLINE void* _xmalloc(size_t n SITE_PARAMS)
+{
+	Site at = SITE_HERE;
+#ifdef LEAKED_QUOTA
+	if (_quota_admit(n, 0, LEAKED_QUOTA_TAG)) return NULL;
+#endif
+	void* p = _raw_malloc(n, 0);
+	if (p) {
+		_junk(p, n);
+		_add_blk(p, n, at, LEAKED_STACK_HERE());
+#ifdef LEAKED_TRACE
+		_trace_event(
+		  LEAKED_TRACE_MALLOC, (uintptr_t)p, 0, n, at, tbuf.stamp, 0);
+#endif
+	}
+	return p;
+}
+
+static void* _xcalloc(size_t nm, size_t s SITE_PARAMS)
+  __attribute__((unused));
+static LEAKED_NOINLINE void* _xcalloc(size_t nm, size_t s SITE_PARAMS)
+{
+	Site at = SITE_HERE;
+	if (nm && s > ((size_t)-1) / nm) return NULL;
+#ifdef LEAKED_QUOTA
+	if (_quota_admit(nm * s, 0, LEAKED_QUOTA_TAG)) return NULL;
+#endif
+	void* p = _raw_malloc(nm * s, 1);
+	if (p) {
+		_add_blk(p, nm * s, at, LEAKED_STACK_HERE());
+#ifdef LEAKED_TRACE
+		_trace_event(
+		  LEAKED_TRACE_MALLOC, (uintptr_t)p, 0, nm * s, at, tbuf.stamp, 0);
+#endif
+	}
+	return p;
+}
+
+static void* _xrealloc(void* old, size_t n SITE_PARAMS)
+  __attribute__((unused));
+static LEAKED_NOINLINE void* _xrealloc(void* old, size_t n SITE_PARAMS)
+{
+	Site at = SITE_HERE;
+#ifdef LEAKED_SLOW_FREE
+	/* the old block can't go straight back to libc, so go through
+	 * malloc/copy/free. old stays valid and tracked when the new block
+	 * can't be had */
+#ifdef LEAKED_QUOTA
+	if (_quota_realloc(old, n)) return NULL;
+#endif
+	void* p = _raw_malloc(n, 0);
+	if (!p) return NULL;
+	Blk ob;
+	ob.ptr = NULL;
+	ob.sz = 0;
+	if (old && !_del_blk(old, at, &ob)) {
+		_raw_free(p, n);
+		return NULL;
+	}
+#ifdef LEAKED_TAGS
+	/* the block keeps its tag */
+	int retag = ob.ptr && ob.tag;
+	if (retag) _tag_push_id(ob.tag);
+#endif
+#ifdef LEAKED_TRACE
+	uint64_t t_free = tbuf.stamp;
+#endif
+	if (old) {
+		memcpy(p, old, ob.sz < n ? ob.sz : n);
+		_release(&ob, at);
+	}
+#else
+	/* drop the old entry before libc may hand the block to another
+	 * thread, even when realloc grows it in place. it's re-added below
+	 * with its new size, or as it was when realloc fails */
+#ifdef LEAKED_QUOTA
+	if (_quota_realloc(old, n)) return NULL;
+#endif
+	Blk ob;
+	ob.ptr = NULL;
+	ob.sz = 0;
+	if (old) _del_blk(old, at, &ob);
+#ifdef LEAKED_TAGS
+	/* the block keeps its tag */
+	int retag = ob.ptr && ob.tag;
+	if (retag) _tag_push_id(ob.tag);
+#endif
+#ifdef LEAKED_TRACE
+	uint64_t t_free = tbuf.stamp;
+#endif
+	void* p = realloc(old, n);
+	if (!p) {
+		if (ob.ptr) {
+			_readd_blk(&ob);
+#ifdef LEAKED_TRACE
+			_trace_event(LEAKED_TRACE_REALLOC,
+						 (uintptr_t)ob.ptr,
+						 (uintptr_t)ob.ptr,
+						 ob.sz,
+						 ob.at,
+						 t_free,
+						 tbuf.stamp - t_free);
+#endif
+		}
+#ifdef LEAKED_TAGS
+		if (retag) leaked_tag_pop();
+#endif
+		return NULL;
+	}
+#endif
+	if (n > ob.sz) _junk((unsigned char*)p + ob.sz, n - ob.sz);
+
+	_add_blk(p, n, at, LEAKED_STACK_HERE());
+#ifdef LEAKED_TAGS
+	if (retag) leaked_tag_pop();
+#endif
+#ifdef LEAKED_TRACE
+	uint64_t t_own = tbuf.stamp;
+	/* ob.ptr is old when it was a tracked block */
+	if (ob.ptr)
+		_trace_event(LEAKED_TRACE_REALLOC,
+					 (uintptr_t)p,
+					 (uintptr_t)ob.ptr,
+					 n,
+					 at,
+					 t_free,
+					 t_own - t_free);
+	else
+		_trace_event(LEAKED_TRACE_MALLOC, (uintptr_t)p, 0, n, at, t_own, 0);
+#endif
+	return p;
+}
+
+static LEAKED_NOINLINE void _xfree(void* p SITE_PARAMS)
+{
+	Site at = SITE_HERE;
+	Blk b;
+	if (p && _del_blk(p, at, &b)) {
+#ifdef LEAKED_TRACE
+		_trace_event(
+		  LEAKED_TRACE_FREE, (uintptr_t)p, 0, 0, at, tbuf.stamp, 0);
+#endif
+		_release(&b, at);
+	}
+}
+
+#ifdef LEAKED_REACHABILITY
+/*
+ * reachability: a conservative mark phase run over the stolen snapshot at
+ * report time. roots are the writable file-backed mappings of every loaded
+ * object (data) with the anonymous mapping right after them (bss), the
+ * calling thread's stack and saved registers, with LEAKED_THREAD_SAFE the
+ * stacks and static TLS of every thread that allocated (their registers
+ * only as far as they were spilled), and leaked_register_root()
+ * ranges. the heap itself is never a root, blocks are only scanned once
+ * something reaches them. every aligned word is first range-checked
+ * against the span of all blocks (AVX2 when available) and only then
+ * binary searched in the address-sorted block array.
+ */
+#define LEAKED_LOST 0
+#define LEAKED_REACHED 1
+#define LEAKED_INDIRECT 2
+
+typedef struct
+{
+	Blk** blk; /* sorted by address */
+	size_t n;
+	uintptr_t lo, hi; /* span of all blocks */
+	const unsigned char** from; /* root pieces */
+	const unsigned char** to;
+	size_t npieces;
+	size_t next_piece;
+} Reach;
+
+/* register [p, p + n) as a root for the reachability scan */
+static void leaked_register_root(const void* p, size_t n)
+  __attribute__((unused));
+static void leaked_register_root(const void* p, size_t n)
+{
+	LOCK();
+	if (mgr.nroots < (size_t)LEAKED_MAX_ROOTS) {
+		mgr.roots[mgr.nroots] = p;
+		mgr.root_sz[mgr.nroots] = n;
+		mgr.nroots++;
+	}
+	UNLOCK();
+}
+
+static void _reach_flatten(Blk* t, Blk** out, size_t* n)
+{
+	while (t) {
+		_reach_flatten(t->left, out, n);
+		out[(*n)++] = t;
+		t = t->right;
+	}
+}
+
+/* slot in blk[] of the block containing v, r->n if none */
+static size_t _reach_lookup(const Reach* r, uintptr_t v)
+{
+	size_t lo = 0, hi = r->n;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)r->blk[mid]->ptr <= v)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const Blk* b = r->blk[lo];
+	uintptr_t s = (uintptr_t)b->ptr;
+	if (v < s || v - s >= (b->sz ? b->sz : 1)) return r->n;
+	return lo;
+}
+
+typedef struct
+{
+	Blk** item;
+	size_t len, cap;
+} Work;
+
+static void _work_push(Work* w, Blk* b)
+{
+	if (w->len == w->cap) {
+		size_t ncap = w->cap ? w->cap * 2 : 256;
+		Blk** n = (Blk**)realloc(w->item, ncap * sizeof(Blk*));
+		if (!n) return; /* out of memory, b stays reached but unscanned */
+		w->item = n;
+		w->cap = ncap;
+	}
+	w->item[w->len++] = b;
+}
+
+/* a word that hit a block: claim it and queue it for scanning */
+static void _reach_hit(const Reach* r, uintptr_t v, Work* w)
+{
+	size_t i = _reach_lookup(r, v);
+	if (i == r->n) return;
+	Blk* b = r->blk[i];
+	unsigned char m = LEAKED_LOST;
+	if (__atomic_compare_exchange_n(&b->mark,
+									&m,
+									LEAKED_REACHED,
+									0,
+									__ATOMIC_RELAXED,
+									__ATOMIC_RELAXED))
+		_work_push(w, b);
+}
+
+static void _reach_words_scalar(const Reach* r,
+								const uintptr_t* p,
+								size_t n,
+								Work* w)
+{
+	for (size_t i = 0; i < n; i++)
+		if (p[i] - r->lo < r->hi - r->lo) _reach_hit(r, p[i], w);
+}
+
+#ifdef LEAKED_HAVE_AVX2
+/* four words per compare: unsigned v - lo < hi - lo via the sign flip */
+__attribute__((target("avx2"))) static void
+_reach_words_avx2(const Reach* r, const uintptr_t* p, size_t n, Work* w)
+{
+	const __m256i flip = _mm256_set1_epi64x((long long)0x8000000000000000ull);
+	const __m256i lo = _mm256_set1_epi64x((long long)r->lo);
+	const __m256i span =
+	  _mm256_xor_si256(_mm256_set1_epi64x((long long)(r->hi - r->lo)), flip);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i d = _mm256_xor_si256(_mm256_sub_epi64(v, lo), flip);
+		__m256i in = _mm256_cmpgt_epi64(span, d);
+		int m = _mm256_movemask_pd(_mm256_castsi256_pd(in));
+		while (m) {
+			int k = __builtin_ctz((unsigned int)m);
+			_reach_hit(r, p[i + (size_t)k], w);
+			m &= m - 1;
+		}
+	}
+	_reach_words_scalar(r, p + i, n - i, w);
+}
+#endif
+
+/* scan the aligned words of [from, to) */
+static void _reach_range(const Reach* r,
+						 const unsigned char* from,
+						 const unsigned char* to,
+						 Work* w)
+{
+	const size_t a = sizeof(uintptr_t);
+	uintptr_t s = ((uintptr_t)from + a - 1) & ~(uintptr_t)(a - 1);
+	if ((uintptr_t)to <= s) return;
+	size_t n = ((uintptr_t)to - s) / a;
+#ifdef LEAKED_HAVE_AVX2
+	static int avx2 = -1;
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	if (avx2) {
+		_reach_words_avx2(r, (const uintptr_t*)s, n, w);
+		return;
+	}
+#endif
+	_reach_words_scalar(r, (const uintptr_t*)s, n, w);
+}
+
+static void _reach_drain(const Reach* r, Work* w)
+{
+	while (w->len) {
+		Blk* b = w->item[--w->len];
+		const unsigned char* u = (const unsigned char*)b->ptr;
+		_reach_range(r, u, u + b->sz, w);
+	}
+}
+
+/* worker: take root pieces until none are left, following each one
+ * through the heap before taking the next */
+static void* _reach_worker(void* arg)
+{
+	Reach* r = (Reach*)arg;
+	Work w = { NULL, 0, 0 };
+	for (;;) {
+		size_t i = __atomic_fetch_add(&r->next_piece, 1, __ATOMIC_RELAXED);
+		if (i >= r->npieces) break;
+		_reach_range(r, r->from[i], r->to[i], &w);
+		_reach_drain(r, &w);
+	}
+	free(w.item);
+	return NULL;
+}
+
+/* split [from, to) into pieces of at most 1 MiB so threads share the work */
+static void _reach_add_root(Reach* r,
+							size_t* cap,
+							const unsigned char* from,
+							const unsigned char* to)
+{
+	const size_t piece = (size_t)1 << 20;
+	while (from < to) {
+		const unsigned char* end =
+		  (size_t)(to - from) > piece ? from + piece : to;
+		if (r->npieces == *cap) {
+			size_t ncap = *cap ? *cap * 2 : 64;
+			const unsigned char** f = (const unsigned char**)realloc(
+			  (void*)r->from, ncap * sizeof(*f));
+			if (!f) return;
+			r->from = f;
+			const unsigned char** t =
+			  (const unsigned char**)realloc((void*)r->to, ncap * sizeof(*t));
+			if (!t) return;
+			r->to = t;
+			*cap = ncap;
+		}
+		r->from[r->npieces] = from;
+		r->to[r->npieces] = end;
+		r->npieces++;
+		from = end;
+	}
+}
+
+/* 1 if a block overlaps [s, e) */
+static int _reach_holds(const Reach* r, uintptr_t s, uintptr_t e)
+{
+	size_t lo = 0, hi = r->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)r->blk[mid]->ptr < e)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo && (uintptr_t)r->blk[lo - 1]->ptr + r->blk[lo - 1]->sz > s;
+}
+
+/* another thread's stack, and an address in its static TLS */
+typedef struct
+{
+	uintptr_t lo, hi;
+	uintptr_t tls;
+} ReachStack;
+
+/*
+ * data/bss of loaded objects, the stack we run on and the other threads'
+ * stacks, from /proc/self/maps. a stack range is cut down to what is
+ * mapped (the main thread's is sized by the rlimit). a TLS block outside
+ * its stack (the main thread's) is scanned with its whole anonymous
+ * mapping, unless blocks live in there
+ */
+static void _reach_map_roots(Reach* r,
+							 size_t* cap,
+							 const void* sp,
+							 const ReachStack* thr,
+							 size_t nthr)
+{
+	FILE* fp = fopen("/proc/self/maps", "r");
+	if (!fp) return;
+	char line[512];
+	uintptr_t prev_end = 0;
+	int prev_file = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long s, e;
+		char perms[5];
+		int path_at = 0;
+		if (sscanf(line,
+				   "%lx-%lx %4s %*s %*s %*s %n",
+				   &s,
+				   &e,
+				   perms,
+				   &path_at) < 3)
+			continue;
+		const char* path = path_at ? line + path_at : "";
+		int file = path[0] == '/';
+		int anon = path[0] == '\n' || path[0] == 0;
+		if ((uintptr_t)sp >= s && (uintptr_t)sp < e)
+			_reach_add_root(
+			  r, cap, (const unsigned char*)sp, (const unsigned char*)e);
+		else if (perms[0] == 'r' && perms[1] == 'w' &&
+				 (file || (anon && prev_file && prev_end == s)))
+			_reach_add_root(
+			  r, cap, (const unsigned char*)s, (const unsigned char*)e);
+		else if (perms[0] == 'r')
+			for (size_t i = 0; i < nthr; i++) {
+				uintptr_t lo = thr[i].lo > s ? thr[i].lo : s;
+				uintptr_t hi = thr[i].hi < e ? thr[i].hi : e;
+				int tls = thr[i].tls >= s && thr[i].tls < e && anon &&
+						  !_reach_holds(r, s, e);
+				if (tls) {
+					lo = s;
+					hi = e;
+				}
+				if (lo < hi) {
+					_reach_add_root(r,
+									cap,
+									(const unsigned char*)lo,
+									(const unsigned char*)hi);
+					if (tls) break;
+				}
+			}
+		prev_end = e;
+		prev_file = file;
+	}
+	fclose(fp);
+}
+
+#ifdef LEAKED_LEAK_ROOTS
+/*
+ * leak roots: the unreached blocks and the pointers between them form the
+ * leak graph (CSR arrays). tarjan's algorithm collapses its strongly
+ * connected components, components nothing else points to are the roots.
+ * every block is then charged to the first root that reaches it, so the
+ * retained sizes add up to the leaked total. edge targets are resolved
+ * through a hash of the 256-byte granules the unreached blocks cover, to
+ * the first block touching the granule and at most a granule's worth of
+ * blocks after it, so building the graph is linear in the bytes scanned.
+ * the rest is linear too apart from sorting the roots.
+ */
+#define LEAKED_LR_SHIFT 8
+
+typedef struct
+{
+	uintptr_t g; /* granule number, 0 = empty */
+	size_t v;	 /* first vertex touching it */
+} LeakCell;
+
+static size_t _lr_slot(uintptr_t g, size_t mask)
+{
+	return (size_t)(((uint64_t)g * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+}
+
+/* vertex holding x, nv if none */
+static size_t _lr_find(const LeakCell* cell,
+					   size_t mask,
+					   Blk* const* vb,
+					   size_t nv,
+					   uintptr_t x)
+{
+	uintptr_t g = x >> LEAKED_LR_SHIFT;
+	size_t i = _lr_slot(g, mask);
+	while (cell[i].g && cell[i].g != g)
+		i = (i + 1) & mask;
+	if (!cell[i].g) return nv;
+	for (size_t v = cell[i].v; v < nv && (uintptr_t)vb[v]->ptr <= x; v++)
+		if (x - (uintptr_t)vb[v]->ptr < (vb[v]->sz ? vb[v]->sz : 1))
+			return v;
+	return nv;
+}
+
+typedef struct
+{
+	size_t v;	  /* a block of the root component */
+	size_t comp;  /* blocks in the component itself */
+	size_t bytes; /* retained */
+	size_t count;
+} LeakRoot;
+
+static int _leak_root_cmp(const void* a, const void* b)
+{
+	const LeakRoot* x = (const LeakRoot*)a;
+	const LeakRoot* y = (const LeakRoot*)b;
+	return x->bytes < y->bytes ? 1 : x->bytes > y->bytes ? -1 : 0;
+}
+
+/* call with the graph of unreached blocks, prints the roots */
+static void _leak_roots(const Reach* r)
+{
+#ifdef LEAKED_SUPPRESS
+	uint32_t nsite;
+	SiteStat* site = _stat_copy(&nsite);
+#endif
+	size_t nv = 0, ng = 0, mask = 0;
+	LeakCell* cell = NULL;
+	Blk** vb = (Blk**)malloc(r->n * sizeof(Blk*));
+	size_t* off = (size_t*)calloc(r->n + 1, sizeof(size_t));
+	if (!vb || !off) goto out0;
+	for (size_t i = 0; i < r->n; i++) {
+		const Blk* b = r->blk[i];
+		if (b->mark == LEAKED_REACHED) continue;
+		vb[nv++] = r->blk[i];
+		uintptr_t s = (uintptr_t)b->ptr;
+		ng += ((s + (b->sz ? b->sz : 1) - 1) >> LEAKED_LR_SHIFT) -
+			  (s >> LEAKED_LR_SHIFT) + 1;
+	}
+	if (!nv) goto out0;
+
+	/* granule -> first vertex touching it, filled in address order */
+	for (mask = 15; mask < 2 * ng; mask = mask * 2 + 1)
+		;
+	cell = (LeakCell*)calloc(mask + 1, sizeof(LeakCell));
+	if (!cell) goto out0;
+	for (size_t v = 0; v < nv; v++) {
+		uintptr_t s = (uintptr_t)vb[v]->ptr;
+		uintptr_t g = s >> LEAKED_LR_SHIFT;
+		uintptr_t last =
+		  (s + (vb[v]->sz ? vb[v]->sz : 1) - 1) >> LEAKED_LR_SHIFT;
+		for (; g <= last; g++) {
+			size_t i = _lr_slot(g, mask);
+			while (cell[i].g && cell[i].g != g)
+				i = (i + 1) & mask;
+			if (!cell[i].g) {
+				cell[i].g = g;
+				cell[i].v = v;
+			}
+		}
+	}
+
+	/* two passes over the contents: count the edges, then fill them in */
+	size_t* adj = NULL;
+	for (int pass = 0; pass < 2; pass++) {
+		size_t e = 0;
+		for (size_t v = 0; v < nv; v++) {
+			const uintptr_t a = sizeof(uintptr_t);
+			uintptr_t s = ((uintptr_t)vb[v]->ptr + a - 1) & ~(a - 1);
+			uintptr_t end = (uintptr_t)vb[v]->ptr + vb[v]->sz;
+			if (pass) off[v] = e;
+			for (; s + a <= end; s += a) {
+				uintptr_t x = *(const uintptr_t*)s;
+				if (x - r->lo >= r->hi - r->lo) continue;
+				size_t t = _lr_find(cell, mask, vb, nv, x);
+				if (t == nv || t == v) continue;
+				if (pass) adj[e] = t;
+				e++;
+			}
+		}
+		if (pass) {
+			off[nv] = e;
+			break;
+		}
+		adj = (size_t*)malloc((e ? e : 1) * sizeof(size_t));
+		if (!adj) goto out0;
+	}
+
+	/* iterative tarjan */
+	size_t* idx = (size_t*)malloc(nv * sizeof(size_t));
+	size_t* low = (size_t*)malloc(nv * sizeof(size_t));
+	size_t* comp = (size_t*)malloc(nv * sizeof(size_t));
+	size_t* stk = (size_t*)malloc(nv * sizeof(size_t));
+	size_t* call = (size_t*)malloc(nv * sizeof(size_t));
+	size_t* pos = (size_t*)malloc(nv * sizeof(size_t));
+	if (!idx || !low || !comp || !stk || !call || !pos) goto out1;
+	const size_t NONE = (size_t)-1;
+	for (size_t v = 0; v < nv; v++)
+		idx[v] = comp[v] = NONE;
+	size_t counter = 0, sp = 0, ncomp = 0;
+	for (size_t root = 0; root < nv; root++) {
+		if (idx[root] != NONE) continue;
+		size_t depth = 0;
+		call[depth++] = root;
+		idx[root] = low[root] = counter++;
+		pos[root] = off[root];
+		stk[sp++] = root;
+		while (depth) {
+			size_t v = call[depth - 1];
+			if (pos[v] < off[v + 1]) {
+				size_t w = adj[pos[v]++];
+				if (idx[w] == NONE) {
+					idx[w] = low[w] = counter++;
+					pos[w] = off[w];
+					stk[sp++] = w;
+					call[depth++] = w;
+				} else if (comp[w] == NONE && idx[w] < low[v])
+					low[v] = idx[w];
+				continue;
+			}
+			if (low[v] == idx[v]) {
+				size_t w;
+				do {
+					w = stk[--sp];
+					comp[w] = ncomp;
+				} while (w != v);
+				ncomp++;
+			}
+			depth--;
+			if (depth) {
+				size_t u = call[depth - 1];
+				if (low[v] < low[u]) low[u] = low[v];
+			}
+		}
+	}
+
+	/* in-degree of each component from other components (reuse low[]) */
+	size_t* indeg = low;
+	size_t* csize = idx;
+	for (size_t c = 0; c < ncomp; c++)
+		indeg[c] = csize[c] = 0;
+	for (size_t v = 0; v < nv; v++) {
+		csize[comp[v]]++;
+		for (size_t e = off[v]; e < off[v + 1]; e++)
+			if (comp[adj[e]] != comp[v]) indeg[comp[adj[e]]]++;
+	}
+
+	LeakRoot* roots = (LeakRoot*)malloc(ncomp * sizeof(LeakRoot));
+	if (!roots) goto out1;
+	size_t nroots = 0;
+	/* pos[] marks visited blocks, stk[] is the dfs stack */
+	for (size_t v = 0; v < nv; v++)
+		pos[v] = 0;
+	for (size_t v = 0; v < nv; v++) {
+		size_t c = comp[v];
+		if (indeg[c] != 0 || pos[v]) continue;
+		LeakRoot* lr = &roots[nroots++];
+		lr->v = v;
+		lr->comp = csize[c];
+		lr->bytes = lr->count = 0;
+		sp = 0;
+		stk[sp++] = v;
+		pos[v] = 1;
+		while (sp) {
+			size_t u = stk[--sp];
+			lr->bytes += vb[u]->sz;
+			lr->count++;
+			for (size_t e = off[u]; e < off[u + 1]; e++) {
+				if (!pos[adj[e]]) {
+					pos[adj[e]] = 1;
+					stk[sp++] = adj[e];
+				}
+			}
+		}
+	}
+	qsort(roots, nroots, sizeof(LeakRoot), _leak_root_cmp);
+	for (size_t i = 0; i < nroots; i++) {
+		Blk* b = vb[roots[i].v];
+#ifdef LEAKED_SUPPRESS
+		/* what a suppressed root holds on to is part of the known leak */
+		if (site && _suppressed(b, site, nsite)) continue;
+#endif
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " leak root: %lu bytes at %p (" SITE_FMT
+					"), retains (%lu) bytes in (%lu) blocks",
+				(unsigned long)b->sz,
+				b->ptr,
+				SITE_ARG(b->at),
+				(unsigned long)roots[i].bytes,
+				(unsigned long)roots[i].count);
+		if (roots[i].comp > 1)
+			fprintf(stderr, ", cycle of (%lu)", (unsigned long)roots[i].comp);
+		fputc('\n', stderr);
+#ifdef LEAKED_STACK_DEPTH
+		_print_stack(b->stack);
+#endif
+	}
+	free(roots);
+out1:
+	free(idx);
+	free(low);
+	free(comp);
+	free(stk);
+	free(call);
+	free(pos);
+	free(adj);
+out0:
+	free(cell);
+	free(vb);
+	free(off);
+#ifdef LEAKED_SUPPRESS
+	free(site);
+#endif
+}
+#endif
+
+/* mark every snapshot block reachable from the roots, then flag unreached
+ * blocks that other unreached blocks point to as indirectly lost */
+static __attribute__((noinline)) void _reach_mark(Blk* root, size_t n)
+{
+	/* on the heap: the span bounds would otherwise sit on the scanned
+	 * stack and pin the lowest block */
+	Reach* r = (Reach*)calloc(1, sizeof(Reach));
+	if (!r) return;
+	r->blk = (Blk**)malloc((n ? n : 1) * sizeof(Blk*));
+	if (r->blk) _reach_flatten(root, r->blk, &r->n);
+	if (!r->n) {
+		free(r->blk);
+		free(r);
+		return;
+	}
+	for (size_t i = 0; i < r->n; i++)
+		r->blk[i]->mark = LEAKED_LOST;
+	r->lo = (uintptr_t)r->blk[0]->ptr;
+	Blk* last = r->blk[r->n - 1];
+	r->hi = (uintptr_t)last->ptr + (last->sz ? last->sz : 1);
+
+	/* registers land in this frame, which is inside the scanned stack */
+	jmp_buf regs;
+	setjmp(regs);
+	size_t cap = 0;
+	ReachStack* thr = NULL;
+	size_t nthr = 0;
+#ifdef LEAKED_THREAD_SAFE
+	LOCK();
+	for (ReachThread* t = _rthreads; t; t = t->next)
+		nthr++;
+	thr = (ReachStack*)malloc((nthr ? nthr : 1) * sizeof(ReachStack));
+	nthr = 0;
+	for (ReachThread* t = thr ? _rthreads : NULL; t; t = t->next) {
+		thr[nthr].lo = (uintptr_t)t->lo;
+		thr[nthr].hi = (uintptr_t)t->hi;
+		thr[nthr].tls = (uintptr_t)t;
+		nthr++;
+	}
+	UNLOCK();
+#endif
+	_reach_map_roots(r, &cap, (const void*)&regs, thr, nthr);
+	free(thr);
+	for (size_t i = 0; i < mgr.nroots; i++)
+		_reach_add_root(r,
+						&cap,
+						(const unsigned char*)mgr.roots[i],
+						(const unsigned char*)mgr.roots[i] + mgr.root_sz[i]);
+
+#ifdef LEAKED_THREAD_SAFE
+	enum { N = LEAKED_SCAN_THREADS > 1 ? LEAKED_SCAN_THREADS : 1 };
+	pthread_t th[N];
+	int started[N];
+	for (size_t t = 1; t < (size_t)N; t++)
+		started[t] = pthread_create(&th[t], NULL, _reach_worker, r) == 0;
+	_reach_worker(r);
+	for (size_t t = 1; t < (size_t)N; t++)
+		if (started[t]) pthread_join(th[t], NULL);
+#else
+	_reach_worker(r);
+#endif
+
+	/* whatever an unreached block points to is indirectly lost */
+	for (size_t i = 0; i < r->n; i++) {
+		Blk* b = r->blk[i];
+		if (b->mark == LEAKED_REACHED) continue;
+		const uintptr_t a = sizeof(uintptr_t);
+		uintptr_t s = ((uintptr_t)b->ptr + a - 1) & ~(a - 1);
+		uintptr_t e = (uintptr_t)b->ptr + b->sz;
+		for (; s + a <= e; s += a) {
+			uintptr_t v = *(const uintptr_t*)s;
+			if (v - r->lo >= r->hi - r->lo) continue;
+			size_t t = _reach_lookup(r, v);
+			if (t != r->n && t != i && r->blk[t]->mark == LEAKED_LOST)
+				r->blk[t]->mark = LEAKED_INDIRECT;
+		}
+	}
+#ifdef LEAKED_LEAK_ROOTS
+	_leak_roots(r);
+#endif
+	free((void*)r->from);
+	free((void*)r->to);
+	free(r->blk);
+	free(r);
+}
+#endif
+
+#ifdef LEAKED_SITE_STATS
+/*
+ * pprof export: profile.proto encoded by hand, not gzipped (pprof takes
+ * it either way). one sample per site entry with alloc_objects,
+ * alloc_space, inuse_objects and inuse_space. file:line sites become a
+ * function named after them; return addresses (stacks, LEAKED_RETADDR)
+ * are written minus one, into the call, with the executable mappings, so
+ * pprof symbolizes them against the binaries
+ */
+typedef struct
+{
+	unsigned char* p;
+	size_t n;
+	size_t cap;
+	int err;
+} PBuf;
+
+static void _pb_put(PBuf* b, const void* d, size_t n)
+{
+	if (b->n + n > b->cap) {
+		size_t cap = b->cap ? b->cap : 4096;
+		while (cap < b->n + n)
+			cap *= 2;
+		unsigned char* p = (unsigned char*)realloc(b->p, cap);
+		if (!p) {
+			b->err = 1;
+			return;
+		}
+		b->p = p;
+		b->cap = cap;
+	}
+	memcpy(b->p + b->n, d, n);
+	b->n += n;
+}
+
+static void _pb_varint(PBuf* b, uint64_t v)
+{
+	unsigned char t[10];
+	size_t n = 0;
+	while (v >= 0x80) {
+		t[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	t[n++] = (unsigned char)v;
+	_pb_put(b, t, n);
+}
+
+static size_t _pb_len(uint64_t v)
+{
+	size_t n = 1;
+	while (v >= 0x80) {
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+static void _pb_uint(PBuf* b, int field, uint64_t v)
+{
+	_pb_varint(b, (uint64_t)field << 3);
+	_pb_varint(b, v);
+}
+
+static void _pb_bytes(PBuf* b, int field, const void* d, size_t n)
+{
+	_pb_varint(b, (uint64_t)field << 3 | 2);
+	_pb_varint(b, n);
+	_pb_put(b, d, n);
+}
+
+/* append message m as field `field` and empty m for the next one */
+static void _pb_msg(PBuf* b, int field, PBuf* m)
+{
+	_pb_bytes(b, field, m->p, m->n);
+	b->err |= m->err;
+	m->n = 0;
+}
+
+static void _pb_packed(PBuf* b, int field, const uint64_t* v, size_t n)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++)
+		len += _pb_len(v[i]);
+	_pb_varint(b, (uint64_t)field << 3 | 2);
+	_pb_varint(b, len);
+	for (size_t i = 0; i < n; i++)
+		_pb_varint(b, v[i]);
+}
+
+typedef struct
+{
+	uint64_t start;
+	uint64_t limit;
+} PMap;
+
+typedef struct
+{
+	PBuf out;
+	PBuf msg;
+	PBuf sub;
+	uint64_t nstr;
+	uint64_t nloc;
+	PMap* map;
+	size_t nmap;
+	uintptr_t* pc; /* address -> location id, open addressing */
+	uint64_t* loc;
+	size_t npc;
+} PProf;
+
+/* strings are a repeated field of the profile, indexed in order */
+static uint64_t _pp_str(PProf* pp, const char* s)
+{
+	_pb_bytes(&pp->out, 6, s, strlen(s));
+	return pp->nstr++;
+}
+
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+static void _pp_maps(PProf* pp)
+{
+	FILE* fp = fopen("/proc/self/maps", "r");
+	if (!fp) return;
+	char line[512];
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long long lo, hi, off;
+		char perms[8];
+		char* path = strchr(line, '/');
+		if (sscanf(line, "%llx-%llx %7s %llx", &lo, &hi, perms, &off) != 4 ||
+			perms[2] != 'x' || !path)
+			continue;
+		PMap* m = (PMap*)realloc(pp->map, (pp->nmap + 1) * sizeof(PMap));
+		if (!m) break;
+		pp->map = m;
+		m[pp->nmap].start = lo;
+		m[pp->nmap].limit = hi;
+		pp->nmap++;
+		path[strcspn(path, "\n")] = 0;
+		uint64_t name = _pp_str(pp, path);
+		_pb_uint(&pp->msg, 1, pp->nmap);
+		_pb_uint(&pp->msg, 2, lo);
+		_pb_uint(&pp->msg, 3, hi);
+		_pb_uint(&pp->msg, 4, off);
+		_pb_uint(&pp->msg, 5, name);
+		_pb_msg(&pp->out, 3, &pp->msg);
+	}
+	fclose(fp);
+}
+
+/* location of a return address, one per distinct address */
+static uint64_t _pp_pc(PProf* pp, const void* pc)
+{
+	uintptr_t a = (uintptr_t)pc - 1;
+	size_t m = pp->npc - 1;
+	size_t k = (size_t)(((uint64_t)a * 0x9e3779b97f4a7c15ull) >> 32) & m;
+	while (pp->pc[k] && pp->pc[k] != a)
+		k = (k + 1) & m;
+	if (pp->pc[k]) return pp->loc[k];
+	pp->pc[k] = a;
+	pp->loc[k] = ++pp->nloc;
+	_pb_uint(&pp->msg, 1, pp->nloc);
+	for (size_t i = 0; i < pp->nmap; i++)
+		if (a >= pp->map[i].start && a < pp->map[i].limit) {
+			_pb_uint(&pp->msg, 2, i + 1);
+			break;
+		}
+	_pb_uint(&pp->msg, 3, a);
+	_pb_msg(&pp->out, 4, &pp->msg);
+	return pp->nloc;
+}
+#endif
+
+static uint64_t _pp_site(PProf* pp, Site at)
+{
+#ifdef LEAKED_RETADDR
+	return _pp_pc(pp, at.pc);
+#else
+	char name[512];
+	snprintf(name, sizeof(name), "%s:%d", at.file, at.line);
+	uint64_t id = ++pp->nloc, fn = _pp_str(pp, name);
+	uint64_t file = _pp_str(pp, at.file);
+	_pb_uint(&pp->msg, 1, id);
+	_pb_uint(&pp->msg, 2, fn);
+	_pb_uint(&pp->msg, 3, fn);
+	_pb_uint(&pp->msg, 4, file);
+	_pb_msg(&pp->out, 5, &pp->msg);
+	_pb_uint(&pp->sub, 1, id);
+	_pb_uint(&pp->sub, 2, (uint64_t)at.line);
+	_pb_uint(&pp->msg, 1, id);
+	_pb_msg(&pp->msg, 4, &pp->sub);
+	_pb_msg(&pp->out, 4, &pp->msg);
+	return id;
+#endif
+}
+
+/* write a pprof heap profile of every site so far, 0 on success */
+static int leaked_write_pprof(const char* path) __attribute__((unused));
+static int leaked_write_pprof(const char* path)
+{
+	uint32_t n;
+	SiteStat* copy = _stat_copy(&n);
+	if (!copy) return -1;
+
+	PProf pp;
+	memset(&pp, 0, sizeof(pp));
+	_pp_str(&pp, "");
+	static const char* const type[] = { "alloc_objects", "count",
+										"alloc_space",	 "bytes",
+										"inuse_objects", "count",
+										"inuse_space",	 "bytes" };
+	uint64_t str[8];
+	for (int i = 0; i < 8; i++)
+		str[i] = _pp_str(&pp, type[i]);
+	for (int i = 0; i < 8; i += 2) {
+		_pb_uint(&pp.msg, 1, str[i]);
+		_pb_uint(&pp.msg, 2, str[i + 1]);
+		_pb_msg(&pp.out, 1, &pp.msg);
+	}
+	_pb_uint(&pp.out, 9, (uint64_t)time(NULL) * 1000000000u);
+	_pb_uint(&pp.out, 14, str[6]);
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+	_pp_maps(&pp);
+#ifdef LEAKED_STACK_DEPTH
+	size_t frames = (size_t)LEAKED_STACK_DEPTH + 1;
+#else
+	size_t frames = 1;
+#endif
+	for (pp.npc = 64; pp.npc < 2 * (size_t)n * frames; pp.npc *= 2)
+		;
+	pp.pc = (uintptr_t*)calloc(pp.npc, sizeof(uintptr_t));
+	pp.loc = (uint64_t*)malloc(pp.npc * sizeof(uint64_t));
+	if (!pp.pc || !pp.loc) pp.out.err = 1;
+#endif
+
+	for (uint32_t i = 0; i < n && !pp.out.err; i++) {
+		const SiteStat* e = &copy[i];
+#ifdef LEAKED_STACK_DEPTH
+		uint64_t loc[LEAKED_STACK_DEPTH + 1];
+#else
+		uint64_t loc[1];
+#endif
+		size_t nl = 0;
+#ifdef LEAKED_STACK_DEPTH
+		const Stack* s = _depot_get(e->stack);
+		for (uint32_t j = 0; s && j < s->n; j++)
+			loc[nl++] = _pp_pc(&pp, s->pc[j]);
+#endif
+		if (!nl) loc[nl++] = _pp_site(&pp, e->at);
+		uint64_t v[4] = { e->allocs, e->alloc_bytes, e->live, e->live_bytes };
+		_pb_packed(&pp.msg, 1, loc, nl);
+		_pb_packed(&pp.msg, 2, v, 4);
+		_pb_msg(&pp.out, 2, &pp.msg);
+	}
+
+	int rc = -1;
+	FILE* fp = pp.out.err ? NULL : fopen(path, "wb");
+	if (fp) {
+		if (fwrite(pp.out.p, 1, pp.out.n, fp) == pp.out.n) rc = 0;
+		if (fclose(fp)) rc = -1;
+	}
+	free(pp.out.p);
+	free(pp.msg.p);
+	free(pp.sub.p);
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+	free(pp.map);
+	free(pp.pc);
+	free(pp.loc);
+#endif
+	free(copy);
+	return rc;
+}
+
+/*
+ * folded stacks, "frame;frame;frame value" per line with the root first,
+ * as flamegraph.pl and most flame graph viewers read them. frames are
+ * return addresses (symbolize with leaked-symbolize -f, the mappings are
+ * in the "# map:" lines on top) and file:line sites. the whole file is
+ * built in one buffer and written at once
+ */
+#define LEAKED_FOLD_INUSE 0 /* live bytes */
+#define LEAKED_FOLD_ALLOC 1 /* bytes ever allocated */
+#define LEAKED_FOLD_COUNT 2 /* allocations */
+
+static int leaked_write_folded(const char* path, int what)
+  __attribute__((unused));
+static int leaked_write_folded(const char* path, int what)
+{
+	uint32_t n;
+	SiteStat* copy = _stat_copy(&n);
+	if (!copy) return -1;
+	PBuf out;
+	memset(&out, 0, sizeof(out));
+	char line[512];
+	int len;
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+	FILE* maps = fopen("/proc/self/maps", "r");
+	while (maps && fgets(line, sizeof(line), maps)) {
+		char* perms = strchr(line, ' ');
+		if (!perms || perms[3] != 'x' || !strchr(line, '/')) continue;
+		_pb_put(&out, "# map: ", 7);
+		_pb_put(&out, line, strlen(line));
+	}
+	if (maps) fclose(maps);
+#endif
+	for (uint32_t i = 0; i < n; i++) {
+		const SiteStat* e = &copy[i];
+		size_t v = what == LEAKED_FOLD_ALLOC	 ? e->alloc_bytes
+				   : what == LEAKED_FOLD_COUNT ? e->allocs
+											   : e->live_bytes;
+		if (!v) continue;
+		const char* sep = "";
+#ifdef LEAKED_STACK_DEPTH
+		const Stack* s = _depot_get(e->stack);
+		for (uint32_t j = s ? s->n : 0; j-- > 0; sep = ";") {
+			len = snprintf(line, sizeof(line), "%s%p", sep, s->pc[j]);
+			_pb_put(&out, line, (size_t)len);
+		}
+#endif
+#ifdef LEAKED_RETADDR
+		if (!*sep) {
+			len = snprintf(line, sizeof(line), "%p", e->at.pc);
+			_pb_put(&out, line, (size_t)len);
+		}
+#else
+		snprintf(line, sizeof(line), "%s%s:%d", sep, e->at.file, e->at.line);
+		_pb_put(&out, line, strlen(line));
+#endif
+		len = snprintf(line, sizeof(line), " %lu\n", (unsigned long)v);
+		_pb_put(&out, line, (size_t)len);
+	}
+	int rc = -1;
+	FILE* fp = out.err ? NULL : fopen(path, "w");
+	if (fp) {
+		if (fwrite(out.p, 1, out.n, fp) == out.n) rc = 0;
+		if (fclose(fp)) rc = -1;
+	}
+	free(out.p);
+	free(copy);
+	return rc;
+}
+
+/*
+ * structured reports: tracker stats, a log2 histogram of live block
+ * sizes, the per-site totals and every live block, as one JSON document
+ * or as CSV rows sharing one header line:
+ *
+ *   record,name,key,ptr,count,bytes,peak_count,peak_bytes,allocs,
+ *   alloc_bytes,kind,stack
+ *
+ * record is stat, hist, site, slack (LEAKED_SLACK: a site's slack in
+ * place of its bytes), tag (LEAKED_TAGS), peak (the sites of the
+ * LEAKED_PEAK_TOP snapshot) or block. a site's key is what runs are
+ * compared by (tools/leaked-diff.c): its file:line, or with
+ * LEAKED_RETADDR a hash of the module and offset of the site and its
+ * stack, which holds across runs of the same build. suppressed sites
+ * and their leaks are kept, with kind "suppressed". rows are streamed
+ * through a large stdio buffer as the table is walked, nothing is built
+ * in memory
+ */
+#define LEAKED_FMT_JSON 0
+#define LEAKED_FMT_CSV 1
+
+static void _rep_str(FILE* fp, int fmt, const char* s)
+{
+	if (fmt == LEAKED_FMT_JSON) {
+		putc('"', fp);
+		for (; *s; s++) {
+			unsigned char c = (unsigned char)*s;
+			if (c == '"' || c == '\\')
+				fprintf(fp, "\\%c", c);
+			else if (c < 0x20)
+				fprintf(fp, "\\u%04x", c);
+			else
+				putc(c, fp);
+		}
+		putc('"', fp);
+	} else if (strpbrk(s, ",\"\r\n")) {
+		putc('"', fp);
+		for (; *s; s++) {
+			if (*s == '"') putc('"', fp);
+			putc(*s, fp);
+		}
+		putc('"', fp);
+	} else
+		fputs(s, fp);
+}
+
+static void _rep_site(FILE* fp, int fmt, Site at)
+{
+	char name[512];
+#ifdef LEAKED_RETADDR
+	snprintf(name, sizeof(name), "%p", at.pc);
+#else
+	snprintf(name, sizeof(name), "%s:%d", at.file, at.line);
+#endif
+	_rep_str(fp, fmt, name);
+}
+
+#ifdef LEAKED_RETADDR
+typedef struct
+{
+	uintptr_t start;
+	uintptr_t limit;
+	uintptr_t off;
+	uint64_t name; /* hash of the file name */
+} RMap;
+
+static uint64_t _rep_mix(uint64_t h, uint64_t v)
+{
+	h = (h ^ v) * 0x100000001b3ull;
+	return h ^ (h >> 29);
+}
+
+static RMap* _rep_maps(size_t* n)
+{
+	RMap* m = NULL;
+	*n = 0;
+	FILE* fp = fopen("/proc/self/maps", "r");
+	if (!fp) return NULL;
+	char line[512];
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long long lo, hi, off;
+		char perms[8];
+		char* path = strrchr(line, '/');
+		if (sscanf(line, "%llx-%llx %7s %llx", &lo, &hi, perms, &off) != 4 ||
+			perms[2] != 'x' || !path)
+			continue;
+		RMap* g = (RMap*)realloc(m, (*n + 1) * sizeof(RMap));
+		if (!g) break;
+		m = g;
+		m[*n].start = (uintptr_t)lo;
+		m[*n].limit = (uintptr_t)hi;
+		m[*n].off = (uintptr_t)off;
+		m[*n].name = 0xcbf29ce484222325ull;
+		for (char* c = path + 1; *c && *c != '\n'; c++)
+			m[*n].name = _rep_mix(m[*n].name, (unsigned char)*c);
+		(*n)++;
+	}
+	fclose(fp);
+	return m;
+}
+
+static uint64_t _rep_pc(uint64_t h, const RMap* m, size_t n, const void* pc)
+{
+	uintptr_t a = (uintptr_t)pc;
+	for (size_t i = 0; i < n; i++)
+		if (a >= m[i].start && a < m[i].limit)
+			return _rep_mix(_rep_mix(h, m[i].name), a - m[i].start + m[i].off);
+	return _rep_mix(h, a);
+}
+#endif
+
+/* the key column of a site */
+static void
+_rep_key(FILE* fp, int fmt, const SiteStat* e, const void* maps, size_t n)
+{
+#ifdef LEAKED_RETADDR
+	const RMap* m = (const RMap*)maps;
+	uint64_t h = _rep_pc(0xcbf29ce484222325ull, m, n, e->at.pc);
+#ifdef LEAKED_STACK_DEPTH
+	const Stack* s = _depot_get(e->stack);
+	for (uint32_t i = 0; s && i < s->n; i++)
+		h = _rep_pc(h, m, n, s->pc[i]);
+#endif
+	fprintf(fp,
+			fmt == LEAKED_FMT_JSON ? "\"h:%016llx\"" : "h:%016llx",
+			(unsigned long long)h);
+#else
+	(void)maps;
+	(void)n;
+	_rep_site(fp, fmt, e->at);
+#endif
+}
+
+/* the stack column: a JSON array, or frames joined by ';' */
+static void _rep_stack(FILE* fp, int fmt, uint32_t id)
+{
+#ifdef LEAKED_STACK_DEPTH
+	const Stack* s = _depot_get(id);
+	if (fmt == LEAKED_FMT_JSON) fputs(",\"stack\":[", fp);
+	for (uint32_t i = 0; s && i < s->n; i++)
+		fprintf(fp,
+				fmt == LEAKED_FMT_JSON ? "%s\"%p\"" : "%s%p",
+				i ? (fmt == LEAKED_FMT_JSON ? "," : ";") : "",
+				s->pc[i]);
+	if (fmt == LEAKED_FMT_JSON) putc(']', fp);
+#else
+	(void)fp;
+	(void)fmt;
+	(void)id;
+#endif
+}
+
+static const char* _rep_kind(const Blk* b, int marked, int suppressed)
+{
+#ifdef LEAKED_REACHABILITY
+	if (marked && b->mark == LEAKED_REACHED) return "reachable";
+	if (marked && suppressed) return "suppressed";
+	if (marked && b->mark == LEAKED_INDIRECT) return "indirect";
+#else
+	(void)b;
+	if (marked && suppressed) return "suppressed";
+#endif
+	return marked ? "leak" : "live";
+}
+
+/* one report of `table`. `marked`: the blocks went through the leak
+ * classification of show_leaks, otherwise they're just live */
+static int _report(const char* path,
+				   int fmt,
+				   Blk** table,
+				   size_t cap,
+				   const SiteStat* site,
+				   uint32_t nsite,
+				   int marked)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp) return -1;
+	setvbuf(fp, NULL, _IOFBF, (size_t)1 << 20);
+	int json = fmt == LEAKED_FMT_JSON;
+	size_t blocks = 0, bytes = 0, hist_n[65], hist_b[65];
+	memset(hist_n, 0, sizeof(hist_n));
+	memset(hist_b, 0, sizeof(hist_b));
+	for (size_t i = 0; i < cap; i++)
+		for (Blk* b = table[i]; b; b = b->next) {
+			int k = b->sz > 1 ? 64 - __builtin_clzll((uint64_t)b->sz - 1) : 0;
+			hist_n[k]++;
+			hist_b[k] += b->sz;
+			blocks++;
+			bytes += b->sz;
+		}
+#ifdef LEAKED_STACK_DEPTH
+	size_t stacks = __atomic_load_n(&_depot_next, __ATOMIC_RELAXED);
+#else
+	size_t stacks = 0;
+#endif
+	void* maps = NULL;
+	size_t nmaps = 0;
+#ifdef LEAKED_RETADDR
+	maps = _rep_maps(&nmaps);
+#endif
+	const char* stat[] = { "live_blocks", "live_bytes", "sites",
+						   "stacks",	  "table_capacity", "peak_blocks",
+						   "peak_bytes",
+#ifdef LEAKED_SLACK
+						   "live_slack",  "alloc_bytes",	"alloc_slack",
+#endif
+	};
+	size_t val[] = { blocks, bytes, nsite, stacks, cap, stats.peak,
+					 stats.peak_bytes,
+#ifdef LEAKED_SLACK
+					 stats.live_slack, stats.alloc_bytes, stats.alloc_slack,
+#endif
+	};
+	int nstat = (int)(sizeof(val) / sizeof(val[0]));
+
+	if (json) {
+		fputs("{\"stats\":{", fp);
+		for (int i = 0; i < nstat; i++)
+			fprintf(fp,
+					"%s\"%s\":%lu",
+					i ? "," : "",
+					stat[i],
+					(unsigned long)val[i]);
+		fputs("},\n\"histogram\":[", fp);
+	} else {
+		fputs("record,name,key,ptr,count,bytes,peak_count,peak_bytes,allocs,"
+			  "alloc_bytes,kind,stack\n",
+			  fp);
+		for (int i = 0; i < nstat; i++)
+			fprintf(
+			  fp, "stat,%s,,,%lu,,,,,,,\n", stat[i], (unsigned long)val[i]);
+	}
+	const char* sep = "";
+	for (int k = 0; k < 65; k++) {
+		if (!hist_n[k]) continue;
+		unsigned long long le = k < 64 ? 1ull << k : ~0ull;
+		fprintf(fp,
+				json ? "%s{\"size_le\":%llu,\"blocks\":%lu,\"bytes\":%lu}"
+					 : "%shist,<=%llu,,,%lu,%lu,,,,,,\n",
+				sep,
+				le,
+				(unsigned long)hist_n[k],
+				(unsigned long)hist_b[k]);
+		sep = json ? ",\n" : "";
+	}
+
+	if (json) fputs("],\n\"sites\":[", fp);
+	sep = "";
+	for (uint32_t i = 0; i < nsite; i++) {
+		const SiteStat* e = &site[i];
+#ifdef LEAKED_SUPPRESS
+		int hidden = e->suppressed;
+#else
+		int hidden = 0;
+#endif
+		fputs(sep, fp);
+		fputs(json ? "{\"site\":" : "site,", fp);
+		_rep_site(fp, fmt, e->at);
+		fputs(json ? ",\"key\":" : ",", fp);
+		_rep_key(fp, fmt, e, maps, nmaps);
+		fprintf(fp,
+				json ? ",\"live\":%lu,\"live_bytes\":%lu,\"peak_live\":%lu,"
+					   "\"peak_bytes\":%lu,\"allocs\":%lu,\"alloc_bytes\":%lu%s"
+					 : ",,%lu,%lu,%lu,%lu,%lu,%lu,%s,",
+				(unsigned long)e->live,
+				(unsigned long)e->live_bytes,
+				(unsigned long)e->peak_live,
+				(unsigned long)e->peak_bytes,
+				(unsigned long)e->allocs,
+				(unsigned long)e->alloc_bytes,
+				!hidden ? "" : json ? ",\"suppressed\":true" : "suppressed");
+#ifdef LEAKED_SLACK
+		if (json)
+			fprintf(fp,
+					",\"live_slack\":%lu,\"alloc_slack\":%lu",
+					(unsigned long)e->live_slack,
+					(unsigned long)e->alloc_slack);
+#endif
+		_rep_stack(fp, fmt, LEAKED_STAT_STACK(e));
+		fputs(json ? "}" : "\n", fp);
+		sep = json ? ",\n" : "";
+	}
+
+#ifdef LEAKED_SLACK
+	/* csv: a slack row for each site that had any */
+	for (uint32_t i = 0; !json && i < nsite; i++) {
+		const SiteStat* e = &site[i];
+		if (!e->alloc_slack) continue;
+		fputs("slack,", fp);
+		_rep_site(fp, fmt, e->at);
+		fputc(',', fp);
+		_rep_key(fp, fmt, e, maps, nmaps);
+		fprintf(fp,
+				",,%lu,%lu,,,%lu,%lu,,",
+				(unsigned long)e->live,
+				(unsigned long)e->live_slack,
+				(unsigned long)e->allocs,
+				(unsigned long)e->alloc_slack);
+		_rep_stack(fp, fmt, LEAKED_STAT_STACK(e));
+		fputc('\n', fp);
+	}
+#endif
+
+#ifdef LEAKED_TAGS
+	if (json) fputs("],\n\"tags\":[", fp);
+	sep = "";
+	uint32_t ntags = __atomic_load_n(&_ntags, __ATOMIC_ACQUIRE);
+	for (uint32_t i = 0; i < ntags; i++) {
+		const TagStat* t = &_tags[i];
+		if (!t->allocs) continue;
+		fputs(sep, fp);
+		fputs(json ? "{\"tag\":" : "tag,", fp);
+		_rep_str(fp, fmt, t->name);
+		fprintf(fp,
+				json ? ",\"live\":%lu,\"live_bytes\":%lu,\"peak_bytes\":%lu,"
+					   "\"allocs\":%lu,\"alloc_bytes\":%lu}"
+					 : ",,,%lu,%lu,,%lu,%lu,%lu,,\n",
+				(unsigned long)t->live,
+				(unsigned long)t->live_bytes,
+				(unsigned long)t->peak_bytes,
+				(unsigned long)t->allocs,
+				(unsigned long)t->alloc_bytes);
+		sep = json ? ",\n" : "";
+	}
+#endif
+
+#ifdef LEAKED_PEAK_TOP
+	/* the biggest sites at the last peak snapshot */
+	if (json)
+		fprintf(fp,
+				"],\n\"peak\":{\"live_bytes\":%lu,\"sites\":[",
+				(unsigned long)stats.top_bytes);
+	sep = "";
+	for (uint32_t i = 0; i < stats.ntop; i++) {
+		const SiteStat* e = &stats.top[i];
+		fputs(sep, fp);
+		fputs(json ? "{\"site\":" : "peak,", fp);
+		_rep_site(fp, fmt, e->at);
+		fputs(json ? ",\"key\":" : ",", fp);
+		_rep_key(fp, fmt, e, maps, nmaps);
+		fprintf(fp,
+				json ? ",\"live\":%lu,\"live_bytes\":%lu" : ",,%lu,%lu,,,,,,",
+				(unsigned long)e->live,
+				(unsigned long)e->live_bytes);
+		_rep_stack(fp, fmt, LEAKED_STAT_STACK(e));
+		fputs(json ? "}" : "\n", fp);
+		sep = json ? ",\n" : "";
+	}
+	if (json) fputs("]},\n\"blocks\":[", fp);
+#else
+	if (json) fputs("],\n\"blocks\":[", fp);
+#endif
+	sep = "";
+	for (size_t i = 0; i < cap; i++)
+		for (Blk* b = table[i]; b; b = b->next) {
+#ifdef LEAKED_SUPPRESS
+			int hidden = _suppressed(b, site, nsite);
+#else
+			int hidden = 0;
+#endif
+			fputs(sep, fp);
+			fputs(json ? "{\"site\":" : "block,", fp);
+			_rep_site(fp, fmt, b->at);
+			fprintf(fp,
+					json ? ",\"ptr\":\"%p\",\"bytes\":%lu,\"kind\":\"%s\""
+						 : ",,%p,1,%lu,,,,,%s,",
+					b->ptr,
+					(unsigned long)b->sz,
+					_rep_kind(b, marked, hidden));
+#ifdef LEAKED_STACK_DEPTH
+			_rep_stack(fp, fmt, b->stack);
+#endif
+			fputs(json ? "}" : "\n", fp);
+			sep = json ? ",\n" : "";
+		}
+	if (json) fputs("]}\n", fp);
+	free(maps);
+	int rc = ferror(fp) ? -1 : 0;
+	if (fclose(fp)) rc = -1;
+	return rc;
+}
+
+/* write a report of every live block and site so far, 0 on success */
+static int leaked_write_report(const char* path, int fmt)
+  __attribute__((unused));
+static int leaked_write_report(const char* path, int fmt)
+{
+	uint32_t n;
+	SiteStat* site = _stat_copy(&n);
+	if (!site) return -1;
+	LOCK();
+	int rc = _report(path, fmt, mgr.table, mgr.table ? mgr.capacity : 0,
+					 site, n, 0);
+	UNLOCK();
+	free(site);
+	return rc;
+}
+
+/* the reports asked for at build time, of the blocks show_leaks found */
+static void _exit_reports(Blk** table, size_t cap)
+{
+#if defined(LEAKED_JSON) || defined(LEAKED_CSV)
+	uint32_t n;
+	SiteStat* site = _stat_copy(&n);
+	if (!site) return;
+#ifdef LEAKED_JSON
+	if (_report(LEAKED_JSON, LEAKED_FMT_JSON, table, cap, site, n, 1))
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " can't write report %s\n",
+				LEAKED_JSON);
+#endif
+#ifdef LEAKED_CSV
+	if (_report(LEAKED_CSV, LEAKED_FMT_CSV, table, cap, site, n, 1))
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " can't write report %s\n",
+				LEAKED_CSV);
+#endif
+	free(site);
+#else
+	(void)table;
+	(void)cap;
+#endif
+}
+#endif
+
+/* report to stderr at this point */
+static void show_leaks(void)
+{
+#ifdef LEAKED_QUARANTINE
+	_quar_evict(0);
+#endif
+#ifdef LEAKED_REDZONE
+	leaked_check_redzones();
+#endif
+#ifdef LEAKED_PPROF
+	if (leaked_write_pprof(LEAKED_PPROF))
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " can't write profile %s\n",
+				LEAKED_PPROF);
+#endif
+#ifdef LEAKED_FOLDED
+	static const char* const fold[] = { ".inuse.folded",
+										".alloc.folded",
+										".count.folded" };
+	for (int i = 0; i < 3; i++) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s%s", LEAKED_FOLDED, fold[i]);
+		if (leaked_write_folded(path, i))
+			fprintf(stderr,
+					YEL "[LEAKED]" RESET " can't write profile %s\n",
+					path);
+	}
+#endif
+#ifdef LEAKED_PEAK_TOP
+	_print_peak();
+#endif
+#ifdef LEAKED_SLACK
+	_print_slack();
+#endif
+#ifdef LEAKED_SUPPRESS
+	uint32_t nsite;
+	SiteStat* site = _stat_copy(&nsite);
+	long supp_count = 0;
+	size_t supp_bytes = 0;
+#endif
+	LOCK();
+	if (!mgr.table || mgr.alive == 0) {
+		UNLOCK();
+#ifdef LEAKED_SITE_STATS
+		_exit_reports(NULL, 0);
+#endif
+#ifdef LEAKED_SUPPRESS
+		free(site);
+#endif
+		return;
+	}
+	Blk** snapshot = mgr.table;
+	size_t cap_snapshot = mgr.capacity;
+#ifdef LEAKED_REACHABILITY
+	Blk* root_snapshot = mgr.root;
+	size_t alive_snapshot = mgr.alive;
+#endif
+	mgr.table = NULL;
+	mgr.capacity = 0;
+	mgr.alive = 0;
+#ifdef LEAKED_ADDR_INDEX
+	mgr.root = NULL;
+#endif
+	UNLOCK();
+
+	long total_count = 0;
+	size_t total_bytes = 0;
+#ifdef LEAKED_TAGS
+	/* leaks per tag, count then bytes */
+	size_t* by_tag = (size_t*)calloc(2 * LEAKED_MAX_TAGS, sizeof(size_t));
+#endif
+#if defined(LEAKED_STACK_DEPTH) || defined(LEAKED_RETADDR)
+	_print_maps();
+#endif
+#ifdef LEAKED_REACHABILITY
+	long reach_count = 0;
+	size_t reach_bytes = 0;
+	_reach_mark(root_snapshot, alive_snapshot);
+#endif
+#ifdef LEAKED_SITE_STATS
+	_exit_reports(snapshot, cap_snapshot);
+#endif
+
+	for (size_t i = 0; i < cap_snapshot; i++) {
+		for (Blk* b = snapshot[i]; b; b = b->next) {
+			const char* kind = "leak";
+#ifdef LEAKED_REACHABILITY
+			if (b->mark == LEAKED_REACHED) {
+				reach_count++;
+				reach_bytes += b->sz;
+				continue;
+			}
+			if (b->mark == LEAKED_INDIRECT) kind = "indirect leak";
+#endif
+#ifdef LEAKED_SUPPRESS
+			if (site && _suppressed(b, site, nsite)) {
+				supp_count++;
+				supp_bytes += b->sz;
+				continue;
+			}
+#endif
+#ifndef LEAKED_LEAK_ROOTS
+			fprintf(stderr,
+					YEL "[LEAKED]" RESET " %s: %lu bytes at %p (" SITE_FMT
+						")\n",
+					kind,
+					(unsigned long)b->sz,
+					b->ptr,
+					SITE_ARG(b->at));
+#ifdef LEAKED_STACK_DEPTH
+			_print_stack(b->stack);
+#endif
+#else
+			(void)kind;
+#endif
+			total_count++;
+			total_bytes += b->sz;
+#ifdef LEAKED_TAGS
+			if (by_tag) {
+				by_tag[2 * b->tag]++;
+				by_tag[2 * b->tag + 1] += b->sz;
+			}
+#endif
+		}
+	}
+
+	if (total_count > 0)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " total (%ld) leaks, (%lu) bytes\n",
+				total_count,
+				(unsigned long)total_bytes);
+#ifdef LEAKED_TAGS
+	/* split by tag once anything leaked under one */
+	if (by_tag && by_tag[0] < (size_t)total_count) {
+		uint32_t ntags = __atomic_load_n(&_ntags, __ATOMIC_ACQUIRE);
+		for (uint32_t i = 0; i < ntags; i++)
+			if (by_tag[2 * i])
+				fprintf(stderr,
+						YEL "[LEAKED]" RESET " tag %s: (%lu) leaks, (%lu) "
+							"bytes\n",
+						_tags[i].name,
+						(unsigned long)by_tag[2 * i],
+						(unsigned long)by_tag[2 * i + 1]);
+	}
+	free(by_tag);
+#endif
+#ifdef LEAKED_REACHABILITY
+	if (reach_count > 0)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET
+					" still reachable (%ld) blocks, (%lu) bytes\n",
+				reach_count,
+				(unsigned long)reach_bytes);
+#endif
+#ifdef LEAKED_SUPPRESS
+	if (supp_count > 0)
+		fprintf(stderr,
+				YEL "[LEAKED]" RESET " suppressed (%ld) leaks, (%lu) bytes\n",
+				supp_count,
+				(unsigned long)supp_bytes);
+	free(site);
+#endif
+
+	/* free snapshot */
+	for (size_t i = 0; i < cap_snapshot; i++) {
+		Blk* b = snapshot[i];
+		while (b) {
+			Blk* tmp = b;
+			b = b->next;
+#ifdef LEAKED_SHADOW
+			_shadow_clear(tmp->ptr);
+#endif
+			free(tmp);
+		}
+	}
+	free(snapshot);
+}
+
+#if defined(LEAKED_ADDR_INDEX)
+/* name the block a faulting address belongs to, or lies just past / just
+ * before (overflow into a guard page or unmapped memory). runs in the
+ * crash handler, so the index is read without taking the lock */
+static void _report_fault(const void* addr)
+{
+	const long near = 4096 + (long)LEAKED_RZ;
+	Blk* b = _idx_floor(addr);
+	long off = b ? (long)((uintptr_t)addr - (uintptr_t)b->ptr) : 0;
+	if (!b || off >= (long)b->sz + near) {
+		Blk* a = _idx_above(addr);
+		if (!a) return;
+		off = -(long)((uintptr_t)a->ptr - (uintptr_t)addr);
+		if (off < -near) return;
+		b = a;
+	}
+	fprintf(stderr,
+			YEL "[LEAKED]" RESET
+				" fault at %p, offset %ld of %lu-byte block %p (" SITE_FMT
+				")\n",
+			addr,
+			off,
+			(unsigned long)b->sz,
+			b->ptr,
+			SITE_ARG(b->at));
+}
+#elif defined(LEAKED_GUARD_PAGES)
+/* name the block whose guard page was hit. runs in the crash handler, so
+ * the table is walked without taking the lock */
+static void _report_fault(const void* addr)
+{
+	const unsigned char* a = (const unsigned char*)addr;
+	if (!mgr.table) return;
+	for (size_t i = 0; i < mgr.capacity; i++) {
+		for (Blk* b = mgr.table[i]; b; b = b->next) {
+			if (!LEAKED_GUARDED(b->sz)) continue;
+#ifdef LEAKED_GUARD_BEFORE
+			const unsigned char* g =
+			  (const unsigned char*)b->ptr - _page_size();
+#else
+			const unsigned char* g =
+			  (const unsigned char*)b->ptr + _gp_span(b->sz);
+#endif
+			if (a >= g && a < g + _page_size()) {
+				fprintf(stderr,
+						YEL "[LEAKED]" RESET
+							" guard page hit at %p, offset %ld of %lu-byte "
+							"block %p (" SITE_FMT ")\n",
+						addr,
+						(long)(a - (const unsigned char*)b->ptr),
+						(unsigned long)b->sz,
+						b->ptr,
+						SITE_ARG(b->at));
+				return;
+			}
+		}
+	}
+}
+#endif
+
+/*
+ * simple crash handler
+ * TODO: better handler (maybe using async signal??)
+ */
+static void _crash_handler(int sig, siginfo_t* si, void* ctx)
+{
+	(void)ctx;
+	fprintf(stderr, "\n[LEAKED] caught signal %d, dumping leaks...\n", sig);
+#if defined(LEAKED_ADDR_INDEX) || defined(LEAKED_GUARD_PAGES)
+	if (sig == SIGSEGV || sig == SIGBUS) _report_fault(si->si_addr);
+#else
+	(void)si;
+#endif
+#ifdef LEAKED_TRACE
+	_trace_flush(&tbuf);
+#endif
+	show_leaks();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/* print to stderr on program exit or crash */
+static void leaked_init(void)
+{
+	static int done = 0;
+	if (!done) {
+		done = 1;
+		atexit(show_leaks);
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = _crash_handler;
+		sa.sa_flags = SA_SIGINFO;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGSEGV, &sa, NULL);
+		sigaction(SIGBUS, &sa, NULL);
+		sigaction(SIGABRT, &sa, NULL);
+		sigaction(SIGILL, &sa, NULL);
+		sigaction(SIGFPE, &sa, NULL);
+#ifdef LEAKED_SUPPRESS
+		if (*LEAKED_SUPPRESS && leaked_load_suppressions(LEAKED_SUPPRESS) < 0)
+			fprintf(stderr,
+					YEL "[LEAKED]" RESET " can't read suppressions %s\n",
+					LEAKED_SUPPRESS);
+#endif
+	}
+}
+
+/* remap stooodss */
+#undef malloc
+#undef calloc
 #undef realloc
 #undef free
+#ifdef LEAKED_RETADDR
+#define malloc(n) _xmalloc(n)
+#define calloc(n, s) _xcalloc(n, s)
+#define realloc(p, n) _xrealloc(p, n)
+#define free(p) _xfree(p)
+#else
 #define malloc(n) _xmalloc(n, __FILE__, __LINE__)
 #define calloc(n, s) _xcalloc(n, s, __FILE__, __LINE__)
 #define realloc(p, n) _xrealloc(p, n, __FILE__, __LINE__)
 #define free(p) _xfree(p, __FILE__, __LINE__)
+#endif
 
 #endif /* LEAKED_H */
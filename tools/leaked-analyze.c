@@ -0,0 +1,853 @@
+/*
+ *
+ *							LEAKED-ANALYZE
+ * one pass over a LEAKED_TRACE recording: peak live bytes and what was
+ * live at the peak, blocks still live at the end, and per site the
+ * allocation rate, lifetimes and live bytes over time.
+ *
+ * USAGE:
+ *     cc -O2 -pthread tools/leaked-analyze.c -o leaked-analyze
+ *     ./leaked-analyze [-j threads] [-i ms] [-n sites] leaked.trace
+ *     ./leaked-analyze -t seconds [-n sites] leaked.trace
+ *
+ * NOTES:
+ *     - chunks are decoded in parallel (-j, default 4) a bounded window
+ *       ahead of a time-ordered merge, memory is the live heap of the
+ *       recorded program plus the window, not the size of the trace
+ *     - -i sets the timeline interval (default a 20th of the trace),
+ *       -n how many sites are listed (default 20)
+ *     - lifetimes are bucketed by powers of two, percentiles are the
+ *       upper bound of their bucket
+ *     - -t rebuilds the live heap that many seconds into the trace: it
+ *       starts from the latest checkpoint before then (LEAKED_TRACE_CHECKPOINT)
+ *       and replays only the chunks overlapping the rest. the index at the
+ *       end of the file saves reading the chunk headers
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "leaked-trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define WINDOW 64 /* chunks decoded ahead of the merge */
+
+typedef struct
+{
+	uint64_t t;
+	uint64_t ptr;
+	uint64_t old;
+	uint64_t size;
+	uint64_t gap;
+	uint32_t site;
+	int op;
+} Ev;
+
+/* an 'E' chunk and, once a worker got to it, its events */
+typedef struct
+{
+	size_t off;
+	uint64_t t0;
+	uint64_t span;
+	Ev* ev;
+	size_t n;
+	size_t pos; /* merge cursor */
+	int ready;
+} Chunk;
+
+typedef struct
+{
+	char* name;
+	uint64_t allocs;
+	uint64_t bytes;
+	uint64_t live;
+	uint64_t live_max;
+	uint64_t leaked;
+	uint64_t leaked_n;
+	uint64_t peak_freed; /* freed after the peak, but live at it */
+	uint64_t peak_gen;
+	uint64_t life[64]; /* log2 ns */
+	uint64_t* timeline;
+	size_t ntimeline;
+} Site;
+
+typedef struct
+{
+	uint64_t ptr; /* 0 = empty */
+	uint64_t size;
+	uint64_t t;
+	uint32_t site;
+} Blk;
+
+typedef struct
+{
+	Blk* b;
+	size_t cap;
+	size_t n;
+} Live;
+
+/* a 'C' chunk */
+typedef struct
+{
+	size_t off;
+	uint64_t t;
+} Ckpt;
+
+static LtFile file;
+static Chunk* chunks;
+static size_t nchunks;
+static Ckpt* ckpts;
+static size_t nckpts;
+static Site* sites;
+static size_t nsites;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static size_t next_job;	  /* next chunk a worker takes */
+static size_t next_open; /* next chunk the merge opens */
+
+static void* xalloc(size_t n)
+{
+	void* p = malloc(n ? n : 1);
+	if (!p) {
+		fprintf(stderr, "leaked-analyze: out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void* xgrow(void* p, size_t* cap, size_t elem)
+{
+	*cap = *cap ? *cap * 2 : 64;
+	p = realloc(p, *cap * elem);
+	if (!p) {
+		fprintf(stderr, "leaked-analyze: out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+/* --- live set ------------------------------------------------------------ */
+
+static size_t live_hash(uint64_t k, size_t cap)
+{
+	return (size_t)((k * 0x9e3779b97f4a7c15ull) >> 20) & (cap - 1);
+}
+
+static void live_put(Live* l, const Blk* b);
+
+static void live_grow(Live* l)
+{
+	Live o = *l;
+	l->cap = o.cap ? o.cap * 2 : 4096;
+	l->n = 0;
+	l->b = (Blk*)xalloc(l->cap * sizeof(Blk));
+	memset(l->b, 0, l->cap * sizeof(Blk));
+	for (size_t i = 0; i < o.cap; i++)
+		if (o.b[i].ptr) live_put(l, &o.b[i]);
+	free(o.b);
+}
+
+static void live_put(Live* l, const Blk* b)
+{
+	if (2 * (l->n + 1) > l->cap) live_grow(l);
+	size_t i = live_hash(b->ptr, l->cap);
+	while (l->b[i].ptr && l->b[i].ptr != b->ptr)
+		i = (i + 1) & (l->cap - 1);
+	if (!l->b[i].ptr) l->n++;
+	l->b[i] = *b;
+}
+
+/* remove ptr into *out, 0 if it wasn't live */
+static int live_take(Live* l, uint64_t ptr, Blk* out)
+{
+	if (!l->cap || !ptr) return 0;
+	size_t m = l->cap - 1;
+	size_t i = live_hash(ptr, l->cap);
+	while (l->b[i].ptr && l->b[i].ptr != ptr)
+		i = (i + 1) & m;
+	if (!l->b[i].ptr) return 0;
+	*out = l->b[i];
+	for (size_t j = (i + 1) & m; l->b[j].ptr; j = (j + 1) & m) {
+		size_t h = live_hash(l->b[j].ptr, l->cap);
+		if (((j - h) & m) >= ((j - i) & m)) {
+			l->b[i] = l->b[j];
+			i = j;
+		}
+	}
+	l->b[i].ptr = 0;
+	l->n--;
+	return 1;
+}
+
+/* --- decoding ------------------------------------------------------------ */
+
+static void decode(Chunk* c)
+{
+	LtChunk lc;
+	LtEvents it;
+	LtEvent e;
+	size_t off = c->off, cap = 0;
+	c->ev = NULL;
+	c->n = 0;
+	if (!lt_chunk(&file, &off, &lc) || !lt_events(&lc, &it)) return;
+	while (lt_event(&it, &e)) {
+		if (c->n == cap) c->ev = (Ev*)xgrow(c->ev, &cap, sizeof(Ev));
+		Ev* v = &c->ev[c->n++];
+		v->t = e.t;
+		v->ptr = e.ptr;
+		v->old = e.old;
+		v->size = e.size;
+		v->gap = e.gap;
+		v->site = e.site < nsites ? e.site : 0;
+		v->op = e.op;
+	}
+}
+
+static void* worker(void* arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (next_job < nchunks && next_job >= next_open + WINDOW)
+			pthread_cond_wait(&cond, &lock);
+		if (next_job >= nchunks) break;
+		Chunk* c = &chunks[next_job++];
+		pthread_mutex_unlock(&lock);
+		decode(c);
+		pthread_mutex_lock(&lock);
+		c->ready = 1;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+static int chunk_cmp(const void* a, const void* b)
+{
+	const Chunk* x = (const Chunk*)a;
+	const Chunk* y = (const Chunk*)b;
+	if (x->t0 != y->t0) return x->t0 < y->t0 ? -1 : 1;
+	return x->off < y->off ? -1 : 1;
+}
+
+static size_t sites_cap, chunks_cap, ckpts_cap;
+
+static void add_site(const LtChunk* c)
+{
+	LtSite s;
+	if (!lt_site(c, &s) || !s.id) return;
+	while (s.id >= sites_cap) {
+		size_t old = sites_cap;
+		sites = (Site*)xgrow(sites, &sites_cap, sizeof(Site));
+		memset(sites + old, 0, (sites_cap - old) * sizeof(Site));
+	}
+	char* name = (char*)xalloc(s.name_len + 32);
+	if (s.name_len)
+		snprintf(name,
+				 s.name_len + 32,
+				 "%.*s:%u",
+				 (int)s.name_len,
+				 s.name,
+				 s.line);
+	else
+		snprintf(name, 32, "0x%llx", (unsigned long long)s.pc);
+	memset(&sites[s.id], 0, sizeof(Site));
+	sites[s.id].name = name;
+	if (s.id >= nsites) nsites = s.id + 1;
+}
+
+static void add_chunk(size_t off, uint64_t t0, uint64_t span)
+{
+	if (nchunks == chunks_cap)
+		chunks = (Chunk*)xgrow(chunks, &chunks_cap, sizeof(Chunk));
+	memset(&chunks[nchunks], 0, sizeof(Chunk));
+	chunks[nchunks].off = off;
+	chunks[nchunks].t0 = t0;
+	chunks[nchunks].span = span;
+	nchunks++;
+}
+
+static void add_ckpt(size_t off, uint64_t t)
+{
+	if (nckpts == ckpts_cap)
+		ckpts = (Ckpt*)xgrow(ckpts, &ckpts_cap, sizeof(Ckpt));
+	ckpts[nckpts].off = off;
+	ckpts[nckpts].t = t;
+	nckpts++;
+}
+
+/* sites, chunks and checkpoints, from the index or the chunk headers */
+static void scan(void)
+{
+	LtChunk c;
+	LtIndex idx;
+	nsites = 1;
+	sites_cap = 64;
+	sites = (Site*)xalloc(sites_cap * sizeof(Site));
+	memset(sites, 0, sizeof(Site));
+	sites[0].name = (char*)"?";
+	if (lt_index(&file, &idx)) {
+		LtIndexEntry e;
+		while (lt_index_next(&idx, &e)) {
+			size_t off = e.off;
+			if (e.type == 'S' && lt_chunk(&file, &off, &c))
+				add_site(&c);
+			else if (e.type == 'E')
+				add_chunk(e.off, e.t0, e.span);
+			else if (e.type == 'C')
+				add_ckpt(e.off, e.t0);
+		}
+	} else
+		for (size_t off = 0; lt_chunk(&file, &off, &c);) {
+			LtEvents it;
+			LtBlocks bl;
+			if (c.type == 'S')
+				add_site(&c);
+			else if (c.type == 'E' && lt_events(&c, &it))
+				add_chunk(c.off, it.t0, it.span);
+			else if (c.type == 'C' && lt_blocks(&c, &bl))
+				add_ckpt(c.off, bl.t);
+		}
+	for (size_t i = 1; i < nsites; i++)
+		if (!sites[i].name) sites[i].name = (char*)"?";
+	qsort(chunks, nchunks, sizeof(Chunk), chunk_cmp);
+}
+
+/* --- merge --------------------------------------------------------------- */
+
+/* min-heap of open chunks by the time of their next event */
+typedef struct
+{
+	Chunk** h;
+	size_t n;
+	size_t cap;
+} Heap;
+
+static uint64_t heap_key(const Chunk* c)
+{
+	return c->ev[c->pos].t;
+}
+
+static void heap_down(Heap* q, size_t i)
+{
+	for (;;) {
+		size_t l = 2 * i + 1, m = i;
+		if (l < q->n && heap_key(q->h[l]) < heap_key(q->h[m])) m = l;
+		if (l + 1 < q->n && heap_key(q->h[l + 1]) < heap_key(q->h[m]))
+			m = l + 1;
+		if (m == i) return;
+		Chunk* t = q->h[i];
+		q->h[i] = q->h[m];
+		q->h[m] = t;
+		i = m;
+	}
+}
+
+static void heap_push(Heap* q, Chunk* c)
+{
+	if (q->n == q->cap) q->h = (Chunk**)xgrow(q->h, &q->cap, sizeof(Chunk*));
+	size_t i = q->n++;
+	q->h[i] = c;
+	while (i && heap_key(q->h[(i - 1) / 2]) > heap_key(q->h[i])) {
+		Chunk* t = q->h[i];
+		q->h[i] = q->h[(i - 1) / 2];
+		q->h[(i - 1) / 2] = t;
+		i = (i - 1) / 2;
+	}
+}
+
+/* realloc halves owning their block after the event that released old */
+typedef struct
+{
+	Blk* h;
+	size_t n;
+	size_t cap;
+} Pending;
+
+static void pend_push(Pending* q, const Blk* b)
+{
+	if (q->n == q->cap) q->h = (Blk*)xgrow(q->h, &q->cap, sizeof(Blk));
+	size_t i = q->n++;
+	q->h[i] = *b;
+	while (i && q->h[(i - 1) / 2].t > q->h[i].t) {
+		Blk t = q->h[i];
+		q->h[i] = q->h[(i - 1) / 2];
+		q->h[(i - 1) / 2] = t;
+		i = (i - 1) / 2;
+	}
+}
+
+static Blk pend_pop(Pending* q)
+{
+	Blk top = q->h[0];
+	q->h[0] = q->h[--q->n];
+	for (size_t i = 0;;) {
+		size_t l = 2 * i + 1, m = i;
+		if (l < q->n && q->h[l].t < q->h[m].t) m = l;
+		if (l + 1 < q->n && q->h[l + 1].t < q->h[m].t) m = l + 1;
+		if (m == i) break;
+		Blk t = q->h[i];
+		q->h[i] = q->h[m];
+		q->h[m] = t;
+		i = m;
+	}
+	return top;
+}
+
+typedef struct
+{
+	Live live;
+	uint64_t bytes;
+	uint64_t blocks;
+	uint64_t peak;
+	uint64_t peak_blocks;
+	uint64_t peak_t;
+	uint64_t peak_gen;
+	uint64_t events;
+	uint64_t unmatched; /* frees of blocks never seen */
+	uint64_t t_first;
+	uint64_t t_last;
+	uint64_t from; /* changes in (from, until] are applied */
+	uint64_t until;
+	uint64_t interval;
+	uint64_t next_sample;
+	size_t samples;
+} State;
+
+static void acquire(State* s, const Blk* b)
+{
+	Blk old;
+	if (live_take(&s->live, b->ptr, &old)) { /* missed free, drop it */
+		s->bytes -= old.size;
+		s->blocks--;
+		sites[old.site].live -= old.size;
+	}
+	live_put(&s->live, b);
+	Site* st = &sites[b->site];
+	st->allocs++;
+	st->bytes += b->size;
+	st->live += b->size;
+	if (st->live > st->live_max) st->live_max = st->live;
+	s->bytes += b->size;
+	s->blocks++;
+	if (s->bytes > s->peak) {
+		s->peak = s->bytes;
+		s->peak_blocks = s->blocks;
+		s->peak_t = b->t;
+		s->peak_gen++;
+	}
+}
+
+static void release(State* s, uint64_t ptr, uint64_t t)
+{
+	Blk b;
+	if (!live_take(&s->live, ptr, &b)) {
+		s->unmatched++;
+		return;
+	}
+	Site* st = &sites[b.site];
+	st->live -= b.size;
+	uint64_t life = t > b.t ? t - b.t : 0;
+	st->life[life ? 64 - __builtin_clzll(life) - 1 : 0]++;
+	/* live at the current peak. a later peak resets this */
+	if (b.t <= s->peak_t) {
+		if (st->peak_gen != s->peak_gen) {
+			st->peak_gen = s->peak_gen;
+			st->peak_freed = 0;
+		}
+		st->peak_freed += b.size;
+	}
+	s->bytes -= b.size;
+	s->blocks--;
+}
+
+static void sample(State* s, uint64_t t)
+{
+	while (t >= s->next_sample) {
+		for (size_t i = 0; i < nsites; i++) {
+			Site* st = &sites[i];
+			if (st->ntimeline == s->samples) {
+				size_t cap = st->ntimeline;
+				st->timeline = (uint64_t*)realloc(
+				  st->timeline, (cap ? cap * 2 : 32) * sizeof(uint64_t));
+				if (!st->timeline) {
+					fprintf(stderr, "leaked-analyze: out of memory\n");
+					exit(1);
+				}
+			}
+			st->timeline[s->samples] = st->live;
+			st->ntimeline = s->samples + 1;
+		}
+		s->samples++;
+		s->next_sample += s->interval;
+	}
+}
+
+static void merge(State* s)
+{
+	Heap q = { NULL, 0, 0 };
+	Pending pend = { NULL, 0, 0 };
+	for (;;) {
+		/* open every chunk that may hold events before the next one */
+		while (next_open < nchunks &&
+			   (!q.n || chunks[next_open].t0 <= heap_key(q.h[0]))) {
+			Chunk* c = &chunks[next_open];
+			pthread_mutex_lock(&lock);
+			while (!c->ready)
+				pthread_cond_wait(&cond, &lock);
+			next_open++;
+			pthread_cond_broadcast(&cond);
+			pthread_mutex_unlock(&lock);
+			if (c->n) heap_push(&q, c);
+		}
+		if (!q.n) break;
+		Chunk* c = q.h[0];
+		const Ev* e = &c->ev[c->pos];
+		while (pend.n && pend.h[0].t <= e->t) {
+			Blk b = pend_pop(&pend);
+			acquire(s, &b);
+		}
+		sample(s, e->t);
+		Blk b;
+		b.ptr = e->ptr;
+		b.size = e->size;
+		b.t = e->t;
+		b.site = e->site;
+		int now = e->t > s->from && e->t <= s->until;
+		if (now) {
+			s->t_last = e->t;
+			s->events++;
+		}
+		switch (e->op) {
+		case LT_MALLOC:
+			if (now) acquire(s, &b);
+			break;
+		case LT_FREE:
+			if (now) release(s, e->ptr, e->t);
+			break;
+		case LT_REALLOC:
+			if (now) release(s, e->old, e->t);
+			b.t = e->t + e->gap;
+			if (b.t <= s->from || b.t > s->until)
+				break;
+			else if (e->gap)
+				pend_push(&pend, &b);
+			else
+				acquire(s, &b);
+			break;
+		}
+		if (++c->pos == c->n) {
+			free(c->ev);
+			c->ev = NULL;
+			q.h[0] = q.h[--q.n];
+		}
+		if (q.n) heap_down(&q, 0);
+	}
+	while (pend.n) {
+		Blk b = pend_pop(&pend);
+		acquire(s, &b);
+	}
+	free(q.h);
+	free(pend.h);
+}
+
+/* --- report -------------------------------------------------------------- */
+
+static const char* dur(uint64_t ns, char* buf)
+{
+	if (ns < 1000)
+		sprintf(buf, "%lluns", (unsigned long long)ns);
+	else if (ns < 1000000)
+		sprintf(buf, "%.1fus", (double)ns / 1e3);
+	else if (ns < 1000000000)
+		sprintf(buf, "%.1fms", (double)ns / 1e6);
+	else
+		sprintf(buf, "%.2fs", (double)ns / 1e9);
+	return buf;
+}
+
+/* upper bound of the bucket holding quantile q */
+static uint64_t life_pct(const Site* st, double q)
+{
+	uint64_t n = 0, k = 0;
+	for (int i = 0; i < 64; i++)
+		n += st->life[i];
+	if (!n) return 0;
+	for (int i = 0; i < 64; i++) {
+		k += st->life[i];
+		if ((double)k >= q * (double)n)
+			return i >= 63 ? UINT64_MAX : ((uint64_t)2 << i) - 1;
+	}
+	return 0;
+}
+
+static uint64_t* at_peak;
+
+static int site_cmp(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	if (!sites[x].allocs != !sites[y].allocs) return sites[x].allocs ? -1 : 1;
+	if (at_peak[x] != at_peak[y]) return at_peak[x] > at_peak[y] ? -1 : 1;
+	if (sites[x].bytes != sites[y].bytes)
+		return sites[x].bytes > sites[y].bytes ? -1 : 1;
+	return x < y ? -1 : x > y;
+}
+
+static void report(State* s, size_t top)
+{
+	char b1[32], b2[32], b3[32];
+	double secs = (double)(s->t_last - s->t_first) / 1e9;
+	at_peak = (uint64_t*)xalloc(nsites * sizeof(uint64_t));
+	for (size_t i = 0; i < nsites; i++)
+		at_peak[i] = sites[i].peak_gen == s->peak_gen ? sites[i].peak_freed : 0;
+	for (size_t i = 0; i < s->live.cap; i++) {
+		const Blk* b = &s->live.b[i];
+		if (!b->ptr) continue;
+		sites[b->site].leaked += b->size;
+		sites[b->site].leaked_n++;
+		if (b->t <= s->peak_t) at_peak[b->site] += b->size;
+	}
+
+	printf("%llu events over %s, %lu sites\n",
+		   (unsigned long long)s->events,
+		   dur(s->t_last - s->t_first, b1),
+		   (unsigned long)nsites - 1);
+	printf("peak: %llu bytes in %llu blocks at +%s\n",
+		   (unsigned long long)s->peak,
+		   (unsigned long long)s->peak_blocks,
+		   dur(s->peak_t - s->t_first, b1));
+	printf("live at end: %llu bytes in %llu blocks\n",
+		   (unsigned long long)s->bytes,
+		   (unsigned long long)s->blocks);
+	if (s->unmatched)
+		printf("frees of unknown blocks: %llu\n",
+			   (unsigned long long)s->unmatched);
+
+	uint32_t* order = (uint32_t*)xalloc(nsites * sizeof(uint32_t));
+	for (size_t i = 0; i < nsites; i++)
+		order[i] = (uint32_t)i;
+	qsort(order, nsites, sizeof(uint32_t), site_cmp);
+	/* sites that only ever freed sort last and aren't listed */
+	size_t nlist = 0;
+	while (nlist < nsites && nlist < top && sites[order[nlist]].allocs)
+		nlist++;
+
+	printf("\n%-24s %10s %10s %12s %12s %12s  %s\n",
+		   "site",
+		   "allocs",
+		   "allocs/s",
+		   "bytes",
+		   "at peak",
+		   "at end",
+		   "lifetime p50/p90/p99");
+	for (size_t k = 0; k < nlist; k++) {
+		const Site* st = &sites[order[k]];
+		printf("%-24s %10llu %10.0f %12llu %12llu %12llu  %s/%s/%s\n",
+			   st->name,
+			   (unsigned long long)st->allocs,
+			   secs > 0 ? (double)st->allocs / secs : 0.0,
+			   (unsigned long long)st->bytes,
+			   (unsigned long long)at_peak[order[k]],
+			   (unsigned long long)st->leaked,
+			   dur(life_pct(st, 0.5), b1),
+			   dur(life_pct(st, 0.9), b2),
+			   dur(life_pct(st, 0.99), b3));
+	}
+
+	printf("\nlive bytes per site, every %s:\n", dur(s->interval, b1));
+	for (size_t k = 0; k < nlist; k++) {
+		const Site* st = &sites[order[k]];
+		printf("%-24s", st->name);
+		for (size_t i = 0; i < st->ntimeline; i++)
+			printf(" %llu", (unsigned long long)st->timeline[i]);
+		printf(" %llu\n", (unsigned long long)st->live);
+	}
+
+	size_t shown = 0;
+	for (size_t i = 0; i < s->live.cap && shown < top; i++) {
+		const Blk* b = &s->live.b[i];
+		if (!b->ptr) continue;
+		if (!shown++) printf("\nleaked blocks:\n");
+		printf("%llu bytes at 0x%llx (%s), allocated at +%s\n",
+			   (unsigned long long)b->size,
+			   (unsigned long long)b->ptr,
+			   sites[b->site].name,
+			   dur(b->t - s->t_first, b1));
+	}
+	if (s->blocks > shown)
+		printf("... and %llu more\n",
+			   (unsigned long long)(s->blocks - shown));
+	free(order);
+	free(at_peak);
+}
+
+/* -t: start from the latest checkpoint at or before s->until and keep
+ * only the chunks with changes after it */
+static const Ckpt* seek(State* s)
+{
+	const Ckpt* from = NULL;
+	for (size_t i = 0; i < nckpts; i++)
+		if (ckpts[i].t <= s->until && (!from || ckpts[i].t > from->t))
+			from = &ckpts[i];
+	if (from) {
+		LtChunk c;
+		LtBlocks it;
+		LtBlock lb;
+		size_t off = from->off;
+		if (lt_chunk(&file, &off, &c) && lt_blocks(&c, &it))
+			while (lt_block(&it, &lb)) {
+				Blk b;
+				b.ptr = lb.ptr;
+				b.size = lb.size;
+				b.t = from->t;
+				b.site = lb.site < nsites ? lb.site : 0;
+				acquire(s, &b);
+			}
+		s->from = from->t;
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < nchunks; i++)
+		if (chunks[i].t0 <= s->until && chunks[i].t0 + chunks[i].span > s->from)
+			chunks[n++] = chunks[i];
+	nchunks = n;
+	return from;
+}
+
+static int live_cmp(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	if (sites[x].leaked != sites[y].leaked)
+		return sites[x].leaked > sites[y].leaked ? -1 : 1;
+	return x < y ? -1 : x > y;
+}
+
+static int size_cmp(const void* a, const void* b)
+{
+	const Blk* x = (const Blk*)a;
+	const Blk* y = (const Blk*)b;
+	if (x->size != y->size) return x->size > y->size ? -1 : 1;
+	return x->ptr < y->ptr ? -1 : x->ptr > y->ptr;
+}
+
+/* -t: the heap as it was at s->until */
+static void
+report_at(State* s, const Ckpt* from, uint64_t from_blocks, size_t top)
+{
+	char b1[32];
+	printf("live at +%s: %llu bytes in %llu blocks\n",
+		   dur(s->until - s->t_first, b1),
+		   (unsigned long long)s->bytes,
+		   (unsigned long long)s->blocks);
+	if (from)
+		printf("from the checkpoint at +%s (%llu blocks)",
+			   dur(from->t - s->t_first, b1),
+			   (unsigned long long)from_blocks);
+	else
+		printf("no checkpoint before it");
+	printf(", %llu events replayed from %lu chunks\n",
+		   (unsigned long long)s->events,
+		   (unsigned long)nchunks);
+	if (s->unmatched)
+		printf("frees of unknown blocks: %llu\n",
+			   (unsigned long long)s->unmatched);
+
+	Blk* live = (Blk*)xalloc(s->live.n * sizeof(Blk));
+	size_t n = 0;
+	for (size_t i = 0; i < s->live.cap; i++) {
+		const Blk* b = &s->live.b[i];
+		if (!b->ptr) continue;
+		sites[b->site].leaked += b->size;
+		sites[b->site].leaked_n++;
+		live[n++] = *b;
+	}
+	uint32_t* order = (uint32_t*)xalloc(nsites * sizeof(uint32_t));
+	for (size_t i = 0; i < nsites; i++)
+		order[i] = (uint32_t)i;
+	qsort(order, nsites, sizeof(uint32_t), live_cmp);
+	printf("\n%-24s %10s %12s\n", "site", "blocks", "bytes");
+	for (size_t k = 0; k < nsites && k < top; k++) {
+		const Site* st = &sites[order[k]];
+		if (!st->leaked_n) break;
+		printf("%-24s %10llu %12llu\n",
+			   st->name,
+			   (unsigned long long)st->leaked_n,
+			   (unsigned long long)st->leaked);
+	}
+
+	qsort(live, n, sizeof(Blk), size_cmp);
+	if (n) printf("\nlargest live blocks:\n");
+	for (size_t i = 0; i < n && i < top; i++)
+		printf("%llu bytes at 0x%llx (%s), allocated %s+%s\n",
+			   (unsigned long long)live[i].size,
+			   (unsigned long long)live[i].ptr,
+			   sites[live[i].site].name,
+			   from && live[i].t == from->t ? "before " : "at ",
+			   dur(live[i].t - s->t_first, b1));
+	if (n > top) printf("... and %lu more\n", (unsigned long)(n - top));
+	free(order);
+	free(live);
+}
+
+int main(int argc, char** argv)
+{
+	int jobs = 4;
+	double interval_ms = 0, at_s = -1;
+	size_t top = 20;
+	const char* path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			jobs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			interval_ms = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			top = (size_t)atol(argv[++i]);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			at_s = atof(argv[++i]);
+		else
+			path = argv[i];
+	}
+	if (!path) {
+		fprintf(stderr,
+				"usage: %s [-j threads] [-i ms] [-n sites] [-t seconds] "
+				"trace\n",
+				argv[0]);
+		return 1;
+	}
+	if (jobs < 1) jobs = 1;
+	if (lt_open(&file, path)) return 1;
+	scan();
+
+	State s;
+	memset(&s, 0, sizeof(s));
+	s.until = UINT64_MAX;
+	if (nchunks) {
+		s.t_first = chunks[0].t0;
+		uint64_t span = chunks[nchunks - 1].t0 - s.t_first;
+		s.interval = interval_ms > 0 ? (uint64_t)(interval_ms * 1e6)
+									 : (span / 20 ? span / 20 : 1000000);
+		s.next_sample = s.t_first + s.interval;
+	}
+	const Ckpt* from = NULL;
+	uint64_t from_blocks = 0;
+	if (at_s >= 0) {
+		s.until = s.t_first + (uint64_t)(at_s * 1e9);
+		s.next_sample = UINT64_MAX;
+		from = seek(&s);
+		from_blocks = s.blocks;
+	}
+
+	pthread_t* th = (pthread_t*)xalloc((size_t)jobs * sizeof(pthread_t));
+	for (int i = 0; i < jobs; i++)
+		pthread_create(&th[i], NULL, worker, NULL);
+	merge(&s);
+	for (int i = 0; i < jobs; i++)
+		pthread_join(th[i], NULL);
+	if (at_s >= 0)
+		report_at(&s, from, from_blocks, top);
+	else
+		report(&s, top);
+	lt_close(&file);
+	return 0;
+}
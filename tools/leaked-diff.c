@@ -0,0 +1,498 @@
+/*
+ *
+ *							LEAKED-DIFF
+ * compare the per-site totals of two leaked.h reports (LEAKED_JSON or
+ * LEAKED_CSV, or leaked_write_report) and fail when a site's leaked or
+ * peak bytes grew past a threshold. meant to gate nightly runs against a
+ * stored baseline the way latency regressions are.
+ *
+ * USAGE:
+ *     cc -O2 tools/leaked-diff.c -o leaked-diff
+ *     ./leaked-diff [-p percent] [-b bytes] [-w lines] [-v] base now
+ *
+ * NOTES:
+ *     - a site may grow by -p percent (default 10) of its baseline plus
+ *       -b bytes (default 0), a site new to this run by -b bytes. exits 1
+ *       when one didn't, 2 when a report can't be read
+ *     - sites are matched by their key: file:line, or the module/offset
+ *       hash of LEAKED_RETADDR reports. file:line sites are paired
+ *       within the same file up to -w lines apart (default 20), the line
+ *       shift most of a file's sites agree on first, then the closest
+ *       lines, so code moving around doesn't fail
+ *     - entries sharing a key (one per stack with LEAKED_STACK_DEPTH) are
+ *       summed, peaks included, which makes their peak an upper bound
+ *     - suppressed sites (LEAKED_SUPPRESS) are left out of both reports
+ *     - only changed sites are listed, -v lists all of them
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	char* key;
+	char* name;
+	uint64_t leaked;
+	uint64_t peak;
+	long match; /* index into the other report, -1 = none */
+} Entry;
+
+typedef struct
+{
+	Entry* e;
+	size_t n;
+	size_t cap;
+} Report;
+
+static void* xalloc(size_t n)
+{
+	void* p = malloc(n ? n : 1);
+	if (!p) {
+		fprintf(stderr, "leaked-diff: out of memory\n");
+		exit(2);
+	}
+	return p;
+}
+
+static void
+add(Report* r, char* key, char* name, uint64_t leaked, uint64_t peak)
+{
+	if (r->n == r->cap) {
+		r->cap = r->cap ? r->cap * 2 : 256;
+		r->e = (Entry*)realloc(r->e, r->cap * sizeof(Entry));
+		if (!r->e) {
+			fprintf(stderr, "leaked-diff: out of memory\n");
+			exit(2);
+		}
+	}
+	Entry* e = &r->e[r->n++];
+	e->key = key ? key : strdup(name);
+	e->name = name;
+	e->leaked = leaked;
+	e->peak = peak;
+	e->match = -1;
+}
+
+/* --- JSON: the "sites" array of flat objects ----------------------------- */
+
+static const char* skip_ws(const char* p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ',')
+		p++;
+	return p;
+}
+
+/* a JSON string at p (on the quote), unescaped into *out */
+static const char* json_str(const char* p, char** out)
+{
+	size_t cap = 64, n = 0;
+	char* s = (char*)xalloc(cap);
+	for (p++; *p && *p != '"'; p++) {
+		char c = *p;
+		if (c == '\\' && p[1]) {
+			c = *++p;
+			if (c == 'u' && strlen(p) >= 5) {
+				char hex[5];
+				memcpy(hex, p + 1, 4);
+				hex[4] = 0;
+				c = (char)strtol(hex, NULL, 16);
+				p += 4;
+			} else if (c == 'n')
+				c = '\n';
+			else if (c == 't')
+				c = '\t';
+		}
+		if (n + 1 == cap) s = (char*)realloc(s, cap *= 2);
+		if (!s) exit(2);
+		s[n++] = c;
+	}
+	s[n] = 0;
+	*out = s;
+	return *p ? p + 1 : p;
+}
+
+/* the ',' or closing bracket after the value at p */
+static const char* json_skip(const char* p)
+{
+	int depth = 0;
+	for (; *p; p++) {
+		if (*p == '"') {
+			for (p++; *p && *p != '"'; p++)
+				if (*p == '\\' && p[1]) p++;
+			if (!*p) break;
+		} else if (*p == '[' || *p == '{')
+			depth++;
+		else if (*p == ']' || *p == '}') {
+			if (!depth) return p;
+			depth--;
+		} else if (*p == ',' && !depth)
+			return p;
+	}
+	return p;
+}
+
+static int parse_json(const char* text, Report* r)
+{
+	const char* p = strstr(text, "\"sites\":[");
+	if (!p) return -1;
+	for (p = skip_ws(p + 9); *p == '{'; p = skip_ws(p)) {
+		char *key = NULL, *name = NULL;
+		uint64_t leaked = 0, peak = 0;
+		int supp = 0;
+		for (p = skip_ws(p + 1); *p == '"'; p = skip_ws(p)) {
+			char* field;
+			p = json_str(p, &field);
+			p = skip_ws(p);
+			if (*p++ != ':') {
+				free(field);
+				return -1;
+			}
+			p = skip_ws(p);
+			if (!strcmp(field, "site") && *p == '"')
+				p = json_str(p, &name);
+			else if (!strcmp(field, "key") && *p == '"')
+				p = json_str(p, &key);
+			else {
+				if (!strcmp(field, "live_bytes"))
+					leaked = strtoull(p, NULL, 10);
+				else if (!strcmp(field, "peak_bytes"))
+					peak = strtoull(p, NULL, 10);
+				else if (!strcmp(field, "suppressed"))
+					supp = *p == 't';
+				p = json_skip(p);
+			}
+			free(field);
+		}
+		if (*p++ != '}' || !name) return -1;
+		if (supp) {
+			free(key);
+			free(name);
+			continue;
+		}
+		add(r, key, name, leaked, peak);
+	}
+	return *p == ']' ? 0 : -1;
+}
+
+/* --- CSV: the "site" rows ------------------------------------------------ */
+
+/* split one line into at most n fields, unquoting in place */
+static size_t csv_split(char* line, char** f, size_t n)
+{
+	size_t k = 0;
+	char* p = line;
+	while (k < n) {
+		char* o = p;
+		f[k++] = o;
+		if (*p == '"') {
+			for (p++; *p; p++) {
+				if (*p == '"' && p[1] == '"')
+					p++;
+				else if (*p == '"') {
+					p++;
+					break;
+				}
+				*o++ = *p;
+			}
+		}
+		while (*p && *p != ',' && *p != '\n' && *p != '\r')
+			*o++ = *p++;
+		int more = *p == ',';
+		*o = 0;
+		if (!more) break;
+		p++;
+	}
+	return k;
+}
+
+static int parse_csv(char* text, Report* r)
+{
+	enum { NAME, KEY, BYTES, PEAK, KIND, NCOL };
+	static const char* const want[NCOL] = {
+		"name", "key", "bytes", "peak_bytes", "kind"
+	};
+	int col[NCOL] = { -1, -1, -1, -1, -1 };
+	char* f[32];
+	char* save = NULL;
+	char* line = strtok_r(text, "\n", &save);
+	if (!line) return -1;
+	size_t nf = csv_split(line, f, 32);
+	for (size_t i = 0; i < nf; i++)
+		for (int c = 0; c < NCOL; c++)
+			if (!strcmp(f[i], want[c])) col[c] = (int)i;
+	if (col[NAME] < 0 || col[BYTES] < 0) return -1;
+	while ((line = strtok_r(NULL, "\n", &save))) {
+		nf = csv_split(line, f, 32);
+		if (nf < 2 || strcmp(f[0], "site")) continue;
+		const char* v[NCOL];
+		for (int c = 0; c < NCOL; c++)
+			v[c] = col[c] >= 0 && (size_t)col[c] < nf ? f[col[c]] : "";
+		if (!strcmp(v[KIND], "suppressed")) continue;
+		add(r,
+			*v[KEY] ? strdup(v[KEY]) : NULL,
+			strdup(v[NAME]),
+			strtoull(v[BYTES], NULL, 10),
+			strtoull(v[PEAK], NULL, 10));
+	}
+	return 0;
+}
+
+/* --- matching ------------------------------------------------------------ */
+
+static int key_cmp(const void* a, const void* b)
+{
+	return strcmp(((const Entry*)a)->key, ((const Entry*)b)->key);
+}
+
+/* read a report and merge entries sharing a key */
+static int load(const char* path, Report* r)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+	size_t cap = 1 << 16, n = 0, got;
+	char* text = (char*)xalloc(cap);
+	while ((got = fread(text + n, 1, cap - n - 1, fp)) > 0) {
+		n += got;
+		if (n + 1 == cap) {
+			text = (char*)realloc(text, cap *= 2);
+			if (!text) exit(2);
+		}
+	}
+	fclose(fp);
+	text[n] = 0;
+	const char* s = text;
+	while (*s == ' ' || *s == '\n' || *s == '\t' || *s == '\r')
+		s++;
+	int rc = *s == '{' ? parse_json(s, r) : parse_csv(text, r);
+	free(text);
+	if (rc) {
+		fprintf(stderr, "%s: not a leaked.h report\n", path);
+		return -1;
+	}
+	if (r->n) qsort(r->e, r->n, sizeof(Entry), key_cmp);
+	size_t u = 0;
+	for (size_t i = 0; i < r->n; i++) {
+		if (u && !strcmp(r->e[u - 1].key, r->e[i].key)) {
+			r->e[u - 1].leaked += r->e[i].leaked;
+			r->e[u - 1].peak += r->e[i].peak;
+			free(r->e[i].key);
+			free(r->e[i].name);
+		} else
+			r->e[u++] = r->e[i];
+	}
+	r->n = u;
+	return 0;
+}
+
+/* file and line of a "file:line" key, 0 if it isn't one */
+static int file_line(const char* key, size_t* flen, long* line)
+{
+	const char* c = strrchr(key, ':');
+	if (!c || c == key || !c[1]) return 0;
+	char* end;
+	*line = strtol(c + 1, &end, 10);
+	if (*end) return 0;
+	*flen = (size_t)(c - key);
+	return 1;
+}
+
+typedef struct
+{
+	size_t f; /* first entry of the file in b */
+	long d;	  /* line shift */
+	size_t votes;
+	size_t a;
+	size_t b;
+} Pair;
+
+static int pair_shift(const void* x, const void* y)
+{
+	const Pair* p = (const Pair*)x;
+	const Pair* q = (const Pair*)y;
+	if (p->f != q->f) return p->f < q->f ? -1 : 1;
+	return p->d < q->d ? -1 : p->d > q->d;
+}
+
+static int pair_cmp(const void* x, const void* y)
+{
+	const Pair* p = (const Pair*)x;
+	const Pair* q = (const Pair*)y;
+	if (p->votes != q->votes) return p->votes > q->votes ? -1 : 1;
+	if (labs(p->d) != labs(q->d)) return labs(p->d) < labs(q->d) ? -1 : 1;
+	if (p->a != q->a) return p->a < q->a ? -1 : 1;
+	return p->b < q->b ? -1 : p->b > q->b;
+}
+
+static void match(Report* a, Report* b, long window)
+{
+	size_t fa, fb;
+	long la, lb;
+	/* exact keys other than file:line, both sorted */
+	for (size_t i = 0, j = 0; i < a->n && j < b->n;) {
+		int c = strcmp(a->e[i].key, b->e[j].key);
+		if (!c && !file_line(a->e[i].key, &fa, &la)) {
+			a->e[i].match = (long)j;
+			b->e[j].match = (long)i;
+		}
+		if (c <= 0) i++;
+		if (c >= 0) j++;
+	}
+	/* file:line sites pair up within their file. code moved by an edit
+	 * shifts every site below it by the same amount, so the shifts most
+	 * pairs of a file agree on go first, then closest lines. a site still
+	 * on its old line is one such pair with a shift of 0, and only wins
+	 * when that shift does: after everything moved up by 2, line 14 is
+	 * what used to be line 16. keys sharing the "file:" prefix are a run
+	 * of the sorted report */
+	Pair* pairs = NULL;
+	size_t np = 0, cap = 0;
+	for (size_t i = 0; i < a->n; i++) {
+		if (!file_line(a->e[i].key, &fa, &la)) continue;
+		const char* pre = a->e[i].key;
+		size_t lo = 0, hi = b->n;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (strncmp(b->e[mid].key, pre, fa + 1) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (size_t j = lo; j < b->n && !strncmp(b->e[j].key, pre, fa + 1);
+			 j++) {
+			if (b->e[j].match >= 0 || !file_line(b->e[j].key, &fb, &lb) ||
+				fb != fa || labs(la - lb) > window)
+				continue;
+			if (np == cap) {
+				cap = cap ? cap * 2 : 64;
+				pairs = (Pair*)realloc(pairs, cap * sizeof(Pair));
+				if (!pairs) exit(2);
+			}
+			pairs[np].f = lo;
+			pairs[np].d = lb - la;
+			pairs[np].a = i;
+			pairs[np].b = j;
+			np++;
+		}
+	}
+	if (np) qsort(pairs, np, sizeof(Pair), pair_shift);
+	for (size_t k = 0, run; k < np; k += run) {
+		for (run = 1; k + run < np && !pair_shift(&pairs[k], &pairs[k + run]);
+			 run++)
+			;
+		for (size_t r = 0; r < run; r++)
+			pairs[k + r].votes = run;
+	}
+	if (np) qsort(pairs, np, sizeof(Pair), pair_cmp);
+	for (size_t k = 0; k < np; k++) {
+		Entry* x = &a->e[pairs[k].a];
+		Entry* y = &b->e[pairs[k].b];
+		if (x->match >= 0 || y->match >= 0) continue;
+		x->match = (long)pairs[k].b;
+		y->match = (long)pairs[k].a;
+	}
+	free(pairs);
+}
+
+/* --- compare ------------------------------------------------------------- */
+
+static double pct = 10;
+static uint64_t slack;
+
+static int grew(uint64_t base, uint64_t now)
+{
+	return now > base &&
+		   (double)(now - base) > (double)base * pct / 100 + (double)slack;
+}
+
+static void show(const char* tag,
+				 const Entry* was,
+				 const Entry* now,
+				 const char* name)
+{
+	uint64_t lb = was ? was->leaked : 0, ln = now ? now->leaked : 0;
+	uint64_t pb = was ? was->peak : 0, pn = now ? now->peak : 0;
+	char moved[512] = "";
+	if (was && now && strcmp(was->key, now->key))
+		snprintf(moved, sizeof(moved), " (was %s)", was->name);
+	printf("%-5s %-32s %10llu -> %-10llu %+11lld %10llu -> %-10llu %+11lld%s\n",
+		   tag,
+		   name,
+		   (unsigned long long)lb,
+		   (unsigned long long)ln,
+		   (long long)(ln - lb),
+		   (unsigned long long)pb,
+		   (unsigned long long)pn,
+		   (long long)(pn - pb),
+		   moved);
+}
+
+int main(int argc, char** argv)
+{
+	long window = 20;
+	int verbose = 0;
+	const char* path[2] = { NULL, NULL };
+	int np = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			pct = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			slack = strtoull(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			window = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-v"))
+			verbose = 1;
+		else if (np < 2)
+			path[np++] = argv[i];
+	}
+	if (np != 2) {
+		fprintf(stderr,
+				"usage: %s [-p percent] [-b bytes] [-w lines] [-v] base "
+				"now\n",
+				argv[0]);
+		return 2;
+	}
+	Report base = { NULL, 0, 0 }, now = { NULL, 0, 0 };
+	if (load(path[0], &base) || load(path[1], &now)) return 2;
+	match(&base, &now, window);
+
+	printf("%-5s %-32s %24s %11s %24s %11s\n",
+		   "",
+		   "site",
+		   "leaked bytes",
+		   "",
+		   "peak bytes",
+		   "");
+	size_t failed = 0;
+	uint64_t lb = 0, ln = 0;
+	for (size_t j = 0; j < now.n; j++) {
+		const Entry* n = &now.e[j];
+		const Entry* b = n->match >= 0 ? &base.e[n->match] : NULL;
+		uint64_t bl = b ? b->leaked : 0, bp = b ? b->peak : 0;
+		int bad = grew(bl, n->leaked) || grew(bp, n->peak);
+		failed += (size_t)bad;
+		ln += n->leaked;
+		if (bad || verbose || !b || bl != n->leaked || bp != n->peak)
+			show(bad ? "FAIL" : b ? "" : "new", b, n, n->name);
+	}
+	for (size_t i = 0; i < base.n; i++) {
+		lb += base.e[i].leaked;
+		if (base.e[i].match < 0) show("gone", &base.e[i], NULL, base.e[i].name);
+	}
+	printf("\nleaked %llu -> %llu bytes, %lu of %lu sites over %.1f%% + %llu "
+		   "bytes\n",
+		   (unsigned long long)lb,
+		   (unsigned long long)ln,
+		   (unsigned long)failed,
+		   (unsigned long)now.n,
+		   pct,
+		   (unsigned long long)slack);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,429 @@
+/*
+ *
+ *							LEAKED-REPLAY
+ * re-run the malloc/free/realloc sequence of a LEAKED_TRACE recording
+ * against the tracker as configured at build time, and report throughput,
+ * per-call latency percentiles and peak RSS. every recorded thread gets a
+ * replay thread; a free waits for its allocation when that happened on
+ * another thread, otherwise threads run flat out.
+ *
+ * USAGE:
+ *     cc -O2 -pthread -DLEAKED_THREAD_SAFE tools/leaked-replay.c -o replay
+ *     cc -O2 -pthread -DLEAKED_THREAD_SAFE -DLEAKED_REDZONE=16 ... (any
+ *        combination of leaked.h options)
+ *     cc -O2 -pthread -DLEAKED_DISABLED tools/leaked-replay.c  (plain libc)
+ *     ./replay [-s] leaked.trace
+ *
+ * NOTES:
+ *     - -s replays every thread's events on one thread in time order.
+ *       builds without LEAKED_THREAD_SAFE always do
+ *     - calloc is replayed as malloc, frees of blocks the trace never
+ *       allocated are skipped
+ *     - the trace is decoded up front, about 40 bytes per event
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE 1
+#endif
+
+#include "leaked-trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* the tool's own memory bypasses the tracker through (malloc)(n) etc,
+ * only the replayed calls below go through the macros */
+#ifndef LEAKED_DISABLED
+#define LEAKED_IMPLEMENTATION
+#include "../leaked.h"
+#endif
+
+#define NONE ((uint32_t)-1)
+#define PENDING ((void*)~(uintptr_t)0)
+
+typedef struct
+{
+	uint64_t t;
+	uint64_t ptr;
+	uint64_t old;
+	uint64_t size;
+	uint64_t gap;
+	uint32_t tid;
+	uint32_t slot; /* block this event creates */
+	uint32_t oslot; /* block this event releases */
+	uint32_t seq;	/* position in the file */
+	int op;
+} Rec;
+
+/* one side of an event: a pointer released or acquired at time t */
+typedef struct
+{
+	uint64_t t;
+	uint32_t ev;
+	int acquire;
+} Half;
+
+typedef struct
+{
+	int op;
+	uint32_t slot;
+	uint32_t oslot;
+	size_t size;
+} Op;
+
+typedef struct
+{
+	pthread_t th;
+	Op* ops;
+	size_t n;
+	size_t cap;
+	uint32_t* lat; /* ns per call */
+	int wait;	   /* threaded replay: wait for blocks of other threads */
+} Lane;
+
+static void* volatile* slots;
+static volatile int go;
+
+static void* xalloc(size_t n)
+{
+	void* p = (malloc)(n ? n : 1);
+	if (!p) {
+		fprintf(stderr, "leaked-replay: out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* VmRSS or VmHWM from /proc/self/status, in KB */
+static long rss_kb(const char* field)
+{
+	char line[256];
+	long kb = -1;
+	FILE* fp = fopen("/proc/self/status", "r");
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp))
+		if (!strncmp(line, field, strlen(field))) {
+			kb = strtol(line + strlen(field) + 1, NULL, 10);
+			break;
+		}
+	fclose(fp);
+	return kb;
+}
+
+/* restart the high-water mark so decoding the trace doesn't count */
+static void rss_reset_peak(void)
+{
+	int fd = open("/proc/self/clear_refs", O_WRONLY);
+	if (fd < 0 || write(fd, "5", 1) != 1)
+		fprintf(stderr, "leaked-replay: peak rss includes the trace\n");
+	if (fd >= 0) close(fd);
+}
+
+/* --- live pointer -> slot map, linear probing ---------------------------- */
+
+typedef struct
+{
+	uint64_t* key; /* 0 = empty */
+	uint32_t* val;
+	size_t cap;
+	size_t n;
+} Map;
+
+static size_t map_hash(uint64_t k, size_t cap)
+{
+	return (size_t)((k * 0x9e3779b97f4a7c15ull) >> 20) & (cap - 1);
+}
+
+static void map_put(Map* m, uint64_t k, uint32_t v);
+
+static void map_grow(Map* m)
+{
+	Map o = *m;
+	m->cap = o.cap ? o.cap * 2 : 1024;
+	m->n = 0;
+	m->key = (uint64_t*)xalloc(m->cap * sizeof(uint64_t));
+	m->val = (uint32_t*)xalloc(m->cap * sizeof(uint32_t));
+	memset(m->key, 0, m->cap * sizeof(uint64_t));
+	for (size_t i = 0; i < o.cap; i++)
+		if (o.key[i]) map_put(m, o.key[i], o.val[i]);
+	(free)(o.key);
+	(free)(o.val);
+}
+
+static void map_put(Map* m, uint64_t k, uint32_t v)
+{
+	if (2 * (m->n + 1) > m->cap) map_grow(m);
+	size_t i = map_hash(k, m->cap);
+	while (m->key[i] && m->key[i] != k)
+		i = (i + 1) & (m->cap - 1);
+	if (!m->key[i]) m->n++;
+	m->key[i] = k;
+	m->val[i] = v;
+}
+
+/* remove k, returns its value or NONE */
+static uint32_t map_take(Map* m, uint64_t k)
+{
+	if (!m->cap || !k) return NONE;
+	size_t i = map_hash(k, m->cap);
+	while (m->key[i] && m->key[i] != k)
+		i = (i + 1) & (m->cap - 1);
+	if (!m->key[i]) return NONE;
+	uint32_t v = m->val[i];
+	/* backward shift, no tombstones */
+	for (size_t j = (i + 1) & (m->cap - 1); m->key[j];
+		 j = (j + 1) & (m->cap - 1)) {
+		size_t h = map_hash(m->key[j], m->cap);
+		if (((j - h) & (m->cap - 1)) >= ((j - i) & (m->cap - 1))) {
+			m->key[i] = m->key[j];
+			m->val[i] = m->val[j];
+			i = j;
+		}
+	}
+	m->key[i] = 0;
+	m->n--;
+	return v;
+}
+
+/* --- loading ------------------------------------------------------------- */
+
+static int half_cmp(const void* a, const void* b)
+{
+	const Half* x = (const Half*)a;
+	const Half* y = (const Half*)b;
+	if (x->t != y->t) return x->t < y->t ? -1 : 1;
+	if (x->acquire != y->acquire) return x->acquire - y->acquire;
+	return x->ev < y->ev ? -1 : x->ev > y->ev;
+}
+
+static Rec* load(const char* path, size_t* nrec, uint32_t* nslots)
+{
+	LtFile f;
+	if (lt_open(&f, path)) exit(1);
+	size_t n = 0, cap = 0;
+	Rec* r = NULL;
+	LtChunk c;
+	for (size_t off = 0; lt_chunk(&f, &off, &c);) {
+		LtEvents it;
+		LtEvent e;
+		if (c.type != 'E' || !lt_events(&c, &it)) continue;
+		while (lt_event(&it, &e)) {
+			if (n == cap) {
+				cap = cap ? cap * 2 : 1 << 16;
+				r = (Rec*)(realloc)(r, cap * sizeof(Rec));
+				if (!r) {
+					fprintf(stderr, "leaked-replay: out of memory\n");
+					exit(1);
+				}
+			}
+			Rec* x = &r[n++];
+			x->t = e.t;
+			x->ptr = e.ptr;
+			x->old = e.old;
+			x->size = e.size;
+			x->gap = e.gap;
+			x->tid = e.tid;
+			x->op = e.op;
+			x->slot = x->oslot = NONE;
+			x->seq = (uint32_t)(n - 1);
+		}
+	}
+	lt_close(&f);
+
+	/* walk both sides of every event in time order to give each block its
+	 * own slot, so reused addresses never alias */
+	size_t nh = 0;
+	Half* h = (Half*)xalloc(2 * n * sizeof(Half));
+	for (size_t i = 0; i < n; i++) {
+		if (r[i].op != LT_MALLOC) {
+			h[nh].t = r[i].t;
+			h[nh].ev = (uint32_t)i;
+			h[nh++].acquire = 0;
+		}
+		if (r[i].op != LT_FREE) {
+			h[nh].t = r[i].t + r[i].gap;
+			h[nh].ev = (uint32_t)i;
+			h[nh++].acquire = 1;
+		}
+	}
+	qsort(h, nh, sizeof(Half), half_cmp);
+	Map live = { NULL, NULL, 0, 0 };
+	uint32_t ns = 0;
+	for (size_t i = 0; i < nh; i++) {
+		Rec* x = &r[h[i].ev];
+		if (h[i].acquire) {
+			x->slot = ns++;
+			map_put(&live, x->ptr, x->slot);
+		} else
+			x->oslot = map_take(&live, x->op == LT_REALLOC ? x->old : x->ptr);
+	}
+	(free)(h);
+	(free)(live.key);
+	(free)(live.val);
+	*nrec = n;
+	*nslots = ns;
+	return r;
+}
+
+/* --- replay -------------------------------------------------------------- */
+
+static void lane_push(Lane* l, const Rec* x)
+{
+	if (l->n == l->cap) {
+		l->cap = l->cap ? l->cap * 2 : 1024;
+		l->ops = (Op*)(realloc)(l->ops, l->cap * sizeof(Op));
+		if (!l->ops) {
+			fprintf(stderr, "leaked-replay: out of memory\n");
+			exit(1);
+		}
+	}
+	Op* o = &l->ops[l->n++];
+	o->op = x->op;
+	o->slot = x->slot;
+	o->oslot = x->oslot;
+	o->size = (size_t)x->size;
+}
+
+static void* run(void* arg)
+{
+	Lane* l = (Lane*)arg;
+	while (!__atomic_load_n(&go, __ATOMIC_ACQUIRE))
+		;
+	for (size_t i = 0; i < l->n; i++) {
+		const Op* o = &l->ops[i];
+		void* old = PENDING;
+		if (o->oslot != NONE) {
+			do
+				old = __atomic_load_n(&slots[o->oslot], __ATOMIC_ACQUIRE);
+			while (old == PENDING && l->wait);
+		}
+		int have = old != PENDING;
+		uint64_t t0 = now();
+		void* p = NULL;
+		switch (o->op) {
+		case LT_MALLOC:
+			p = malloc(o->size);
+			break;
+		case LT_FREE:
+			if (have) free(old);
+			break;
+		case LT_REALLOC:
+			p = realloc(have ? old : NULL, o->size);
+			break;
+		}
+		l->lat[i] = (uint32_t)(now() - t0);
+		if (o->slot != NONE)
+			__atomic_store_n(&slots[o->slot], p, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+static int u32_cmp(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int rec_time_cmp(const void* a, const void* b)
+{
+	const Rec* x = (const Rec*)a;
+	const Rec* y = (const Rec*)b;
+	if (x->t != y->t) return x->t < y->t ? -1 : 1;
+	if (x->op != y->op && (x->op == LT_FREE || y->op == LT_FREE))
+		return x->op == LT_FREE ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+int main(int argc, char** argv)
+{
+	int serial = 0;
+	const char* path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s"))
+			serial = 1;
+		else
+			path = argv[i];
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s [-s] trace\n", argv[0]);
+		return 1;
+	}
+#ifndef LEAKED_DISABLED
+	/* no leak report at exit, what the replay leaves behind is the
+	 * recorded program's */
+	(void)leaked_init;
+#ifndef LEAKED_THREAD_SAFE
+	serial = 1; /* the tracker isn't safe to share */
+#endif
+#endif
+
+	size_t n;
+	uint32_t ns;
+	Rec* r = load(path, &n, &ns);
+	uint32_t ntid = 0;
+	for (size_t i = 0; i < n; i++)
+		if (r[i].tid + 1 > ntid) ntid = r[i].tid + 1;
+	if (serial) {
+		/* the same order the slots were handed out in */
+		qsort(r, n, sizeof(Rec), rec_time_cmp);
+		ntid = 1;
+	}
+
+	Lane* lanes = (Lane*)xalloc((ntid ? ntid : 1) * sizeof(Lane));
+	memset(lanes, 0, (ntid ? ntid : 1) * sizeof(Lane));
+	for (size_t i = 0; i < n; i++)
+		lane_push(&lanes[serial ? 0 : r[i].tid], &r[i]);
+	(free)(r);
+	slots = (void* volatile*)xalloc((size_t)ns * sizeof(void*));
+	for (uint32_t i = 0; i < ns; i++)
+		slots[i] = PENDING;
+	uint32_t used = 0;
+	for (uint32_t i = 0; i < ntid; i++) {
+		lanes[i].lat = (uint32_t*)xalloc(lanes[i].n * sizeof(uint32_t));
+		lanes[i].wait = !serial;
+		if (lanes[i].n) used++;
+	}
+	long rss_before = rss_kb("VmRSS");
+	rss_reset_peak();
+
+	for (uint32_t i = 0; i < ntid; i++)
+		if (lanes[i].n) pthread_create(&lanes[i].th, NULL, run, &lanes[i]);
+	uint64_t t0 = now();
+	__atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+	for (uint32_t i = 0; i < ntid; i++)
+		if (lanes[i].n) pthread_join(lanes[i].th, NULL);
+	double secs = (double)(now() - t0) / 1e9;
+
+	uint32_t* lat = (uint32_t*)xalloc(n * sizeof(uint32_t));
+	size_t k = 0;
+	for (uint32_t i = 0; i < ntid; i++) {
+		memcpy(lat + k, lanes[i].lat, lanes[i].n * sizeof(uint32_t));
+		k += lanes[i].n;
+	}
+	qsort(lat, n, sizeof(uint32_t), u32_cmp);
+#define PCT(q) (n ? lat[(size_t)((double)(n - 1) * (q))] : 0)
+	printf("replayed %lu calls on %u thread(s) in %.3f s, %.2f Mcalls/s\n",
+		   (unsigned long)n,
+		   used,
+		   secs,
+		   secs > 0 ? (double)n / secs / 1e6 : 0.0);
+	printf("latency ns: p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+		   PCT(0.5),
+		   PCT(0.9),
+		   PCT(0.99),
+		   PCT(0.999),
+		   PCT(1.0));
+	printf("peak rss: %ld KB (%ld KB before replay)\n",
+		   rss_kb("VmHWM"),
+		   rss_before);
+	return 0;
+}
@@ -0,0 +1,729 @@
+/*
+ *
+ *							LEAKED-SYMBOLIZE
+ * offline symbolizer for leaked.h reports.  reads a report (stdin or a
+ * file), takes the "[LEAKED] map:" lines the tracker dumped next to the raw
+ * addresses, and resolves every address that falls into one of those
+ * mappings to function and file:line using the ELF symbol tables and the
+ * DWARF line tables of the files on disk.  nothing runs inside the traced
+ * process.
+ *
+ * USAGE:
+ *     cc -O2 tools/leaked-symbolize.c -o leaked-symbolize
+ *     ./program 2> report.txt
+ *     ./leaked-symbolize report.txt      (or: leaked-symbolize < report.txt)
+ *     ./leaked-symbolize -f heap.inuse.folded > named.folded
+ *
+ * NOTES:
+ *     - 64-bit little-endian ELF, DWARF 2 to 5 line tables
+ *     - every module is loaded once and every distinct address resolved
+ *       once, the whole report is read before anything is printed
+ *     - compressed debug sections and separate debug files are not read,
+ *       those modules fall back to symbol names only
+ *     - -f is for LEAKED_FOLDED stacks: addresses are replaced by their
+ *       function name instead of annotated, and the map lines dropped
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct
+{
+	uint64_t addr;
+	const char* name;
+} Sym;
+
+typedef struct
+{
+	uint64_t addr;
+	const char* file;
+	unsigned int line;
+	int end; /* end_sequence row, no code at addr */
+} Row;
+
+/* one ELF file, loaded on first use */
+typedef struct
+{
+	char* path;
+	int loaded;
+	const unsigned char* img;
+	size_t img_sz;
+	const Elf64_Phdr* ph;
+	size_t nph;
+	Sym* syms;
+	size_t nsyms;
+	Row* rows;
+	size_t nrows, caprows;
+	char** names; /* joined dir/file strings, freed with the module */
+	size_t nnames, capnames;
+} Module;
+
+/* one "[LEAKED] map:" line */
+typedef struct
+{
+	uint64_t start, end, off;
+	size_t mod; /* index into mods, which moves as it grows */
+} Map;
+
+/* one distinct address of the report */
+typedef struct
+{
+	uint64_t addr;
+	const char* func;
+	const char* file;
+	unsigned int line;
+} Addr;
+
+static Module* mods;
+static size_t nmods;
+static Map* maps;
+static size_t nmaps;
+
+static void* xrealloc(void* p, size_t n)
+{
+	void* q = realloc(p, n);
+	if (!q) {
+		fprintf(stderr, "leaked-symbolize: out of memory\n");
+		exit(1);
+	}
+	return q;
+}
+
+/* --- ELF ---------------------------------------------------------------- */
+
+static const Elf64_Shdr* section(const Module* m, const char* name)
+{
+	const Elf64_Ehdr* eh = (const Elf64_Ehdr*)m->img;
+	if (!eh->e_shoff || eh->e_shstrndx >= eh->e_shnum) return NULL;
+	if (eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > m->img_sz)
+		return NULL;
+	const Elf64_Shdr* sh = (const Elf64_Shdr*)(m->img + eh->e_shoff);
+	const char* strs = (const char*)m->img + sh[eh->e_shstrndx].sh_offset;
+	for (unsigned int i = 0; i < eh->e_shnum; i++) {
+		if (sh[i].sh_type == SHT_NOBITS) continue;
+		if (sh[i].sh_offset + sh[i].sh_size > m->img_sz) continue;
+		if (!strcmp(strs + sh[i].sh_name, name)) return &sh[i];
+	}
+	return NULL;
+}
+
+static int sym_cmp(const void* a, const void* b)
+{
+	uint64_t x = ((const Sym*)a)->addr, y = ((const Sym*)b)->addr;
+	return x < y ? -1 : x > y;
+}
+
+static void load_syms(Module* m, const char* tab, const char* strtab)
+{
+	const Elf64_Shdr* st = section(m, tab);
+	const Elf64_Shdr* ss = section(m, strtab);
+	if (!st || !ss) return;
+	const Elf64_Sym* s = (const Elf64_Sym*)(m->img + st->sh_offset);
+	size_t n = st->sh_size / sizeof(Elf64_Sym);
+	const char* names = (const char*)m->img + ss->sh_offset;
+	m->syms = (Sym*)xrealloc(m->syms, (m->nsyms + n) * sizeof(Sym));
+	for (size_t i = 0; i < n; i++) {
+		if (ELF64_ST_TYPE(s[i].st_info) != STT_FUNC || !s[i].st_value) continue;
+		if (s[i].st_name >= ss->sh_size) continue;
+		m->syms[m->nsyms].addr = s[i].st_value;
+		m->syms[m->nsyms].name = names + s[i].st_name;
+		m->nsyms++;
+	}
+}
+
+/* --- DWARF line tables --------------------------------------------------- */
+
+typedef struct
+{
+	const unsigned char* p;
+	const unsigned char* end;
+} Cur;
+
+static uint64_t uleb(Cur* c)
+{
+	uint64_t v = 0;
+	unsigned int shift = 0;
+	while (c->p < c->end) {
+		unsigned char b = *c->p++;
+		if (shift < 64) v |= (uint64_t)(b & 0x7f) << shift;
+		shift += 7;
+		if (!(b & 0x80)) break;
+	}
+	return v;
+}
+
+static int64_t sleb(Cur* c)
+{
+	int64_t v = 0;
+	unsigned int shift = 0;
+	unsigned char b = 0;
+	while (c->p < c->end) {
+		b = *c->p++;
+		if (shift < 64) v |= (int64_t)(b & 0x7f) << shift;
+		shift += 7;
+		if (!(b & 0x80)) break;
+	}
+	if (shift < 64 && (b & 0x40)) v |= -((int64_t)1 << shift);
+	return v;
+}
+
+static uint64_t fixed(Cur* c, unsigned int n)
+{
+	uint64_t v = 0;
+	if ((size_t)(c->end - c->p) < n) {
+		c->p = c->end;
+		return 0;
+	}
+	for (unsigned int i = 0; i < n; i++)
+		v |= (uint64_t)c->p[i] << (8 * i);
+	c->p += n;
+	return v;
+}
+
+static const char* cstr(Cur* c)
+{
+	const char* s = (const char*)c->p;
+	while (c->p < c->end && *c->p)
+		c->p++;
+	if (c->p < c->end) c->p++;
+	return s;
+}
+
+typedef struct
+{
+	const char* data;
+	size_t size;
+} Strs;
+
+static const char* str_at(const Strs* s, uint64_t off)
+{
+	return s->data && off < s->size ? s->data + off : "??";
+}
+
+/* read one attribute of a v5 directory/file entry. strings come back in
+ * *str, numbers in *num */
+static void read_form(Cur* c,
+					  uint64_t form,
+					  int off64,
+					  const Strs* line_str,
+					  const Strs* str,
+					  const char** s,
+					  uint64_t* num)
+{
+	switch (form) {
+	case 0x08: /* DW_FORM_string */
+		*s = cstr(c);
+		break;
+	case 0x1f: /* DW_FORM_line_strp */
+		*s = str_at(line_str, fixed(c, off64 ? 8 : 4));
+		break;
+	case 0x0e: /* DW_FORM_strp */
+		*s = str_at(str, fixed(c, off64 ? 8 : 4));
+		break;
+	case 0x0f: /* DW_FORM_udata */
+		*num = uleb(c);
+		break;
+	case 0x0b: /* DW_FORM_data1 */
+		*num = fixed(c, 1);
+		break;
+	case 0x05: /* DW_FORM_data2 */
+		*num = fixed(c, 2);
+		break;
+	case 0x06: /* DW_FORM_data4 */
+		*num = fixed(c, 4);
+		break;
+	case 0x07: /* DW_FORM_data8 */
+		*num = fixed(c, 8);
+		break;
+	case 0x1e: /* DW_FORM_data16 */
+		c->p = (size_t)(c->end - c->p) < 16 ? c->end : c->p + 16;
+		break;
+	case 0x09: /* DW_FORM_block */
+	{
+		uint64_t n = uleb(c);
+		c->p = (uint64_t)(c->end - c->p) < n ? c->end : c->p + n;
+		break;
+	}
+	default: /* unknown form, give up on this unit */
+		c->p = c->end;
+		break;
+	}
+}
+
+static const char* join(Module* m, const char* dir, const char* name)
+{
+	if (name[0] == '/' || !dir || !dir[0]) return name;
+	size_t n = strlen(dir) + strlen(name) + 2;
+	char* s = (char*)xrealloc(NULL, n);
+	snprintf(s, n, "%s/%s", dir, name);
+	if (m->nnames == m->capnames) {
+		m->capnames = m->capnames ? m->capnames * 2 : 64;
+		m->names = (char**)xrealloc(m->names, m->capnames * sizeof(char*));
+	}
+	m->names[m->nnames++] = s;
+	return s;
+}
+
+static void emit(Module* m,
+				 uint64_t addr,
+				 const char* file,
+				 unsigned int line,
+				 int end)
+{
+	if (m->nrows == m->caprows) {
+		m->caprows = m->caprows ? m->caprows * 2 : 1024;
+		m->rows = (Row*)xrealloc(m->rows, m->caprows * sizeof(Row));
+	}
+	Row* r = &m->rows[m->nrows++];
+	r->addr = addr;
+	r->file = file;
+	r->line = line;
+	r->end = end;
+}
+
+/* run one line-number program */
+static void line_unit(Module* m, Cur* c, const Strs* line_str, const Strs* str)
+{
+	int off64 = 0;
+	uint64_t len = fixed(c, 4);
+	if (len == 0xffffffffu) {
+		off64 = 1;
+		len = fixed(c, 8);
+	}
+	if (len > (uint64_t)(c->end - c->p)) {
+		c->p = c->end;
+		return;
+	}
+	Cur u = { c->p, c->p + len };
+	c->p += len;
+
+	unsigned int version = (unsigned int)fixed(&u, 2);
+	if (version < 2 || version > 5) return;
+	unsigned int addr_size = 8;
+	if (version >= 5) {
+		addr_size = (unsigned int)fixed(&u, 1);
+		fixed(&u, 1); /* segment selector size */
+	}
+	uint64_t hlen = fixed(&u, off64 ? 8 : 4);
+	if (hlen > (uint64_t)(u.end - u.p)) return;
+	const unsigned char* prog = u.p + hlen;
+	unsigned int min_len = (unsigned int)fixed(&u, 1);
+	if (version >= 4) fixed(&u, 1); /* max ops per instruction */
+	fixed(&u, 1);					/* default_is_stmt */
+	int line_base = (signed char)fixed(&u, 1);
+	unsigned int line_range = (unsigned int)fixed(&u, 1);
+	unsigned int opcode_base = (unsigned int)fixed(&u, 1);
+	if (!line_range || !opcode_base) return;
+	unsigned char std_len[256];
+	for (unsigned int i = 1; i < opcode_base; i++)
+		std_len[i] = (unsigned char)fixed(&u, 1);
+
+	const char* dirs[512];
+	size_t ndirs = 0;
+	const char** files = NULL;
+	size_t nfiles = 0, capfiles = 0;
+	if (version >= 5) {
+		for (int pass = 0; pass < 2; pass++) {
+			unsigned int nfmt = (unsigned int)fixed(&u, 1);
+			uint64_t fmt[32][2];
+			for (unsigned int i = 0; i < nfmt && i < 32; i++) {
+				fmt[i][0] = uleb(&u);
+				fmt[i][1] = uleb(&u);
+			}
+			uint64_t count = uleb(&u);
+			for (uint64_t k = 0; k < count && u.p < u.end; k++) {
+				const char* path = "??";
+				uint64_t dir = 0;
+				for (unsigned int i = 0; i < nfmt && i < 32; i++) {
+					const char* s = NULL;
+					uint64_t num = 0;
+					read_form(&u, fmt[i][1], off64, line_str, str, &s, &num);
+					if (fmt[i][0] == 1 && s) path = s; /* DW_LNCT_path */
+					if (fmt[i][0] == 2) dir = num;	   /* directory_index */
+				}
+				if (!pass) {
+					if (ndirs < 512) dirs[ndirs++] = path;
+					continue;
+				}
+				if (nfiles == capfiles) {
+					capfiles = capfiles ? capfiles * 2 : 64;
+					files = (const char**)xrealloc((void*)files,
+												   capfiles * sizeof(char*));
+				}
+				files[nfiles++] = join(m, dir < ndirs ? dirs[dir] : NULL, path);
+			}
+		}
+	} else {
+		dirs[ndirs++] = NULL; /* index 0 is the compilation directory */
+		while (u.p < u.end && *u.p) {
+			const char* d = cstr(&u);
+			if (ndirs < 512) dirs[ndirs++] = d;
+		}
+		u.p++;
+		/* file numbers start at 1, keep slot 0 empty */
+		capfiles = 64;
+		files = (const char**)xrealloc(NULL, capfiles * sizeof(char*));
+		files[nfiles++] = "??";
+		while (u.p < u.end && *u.p) {
+			const char* name = cstr(&u);
+			uint64_t dir = uleb(&u);
+			uleb(&u);
+			uleb(&u);
+			if (nfiles == capfiles) {
+				capfiles *= 2;
+				files = (const char**)xrealloc((void*)files,
+											   capfiles * sizeof(char*));
+			}
+			files[nfiles++] = join(m, dir < ndirs ? dirs[dir] : NULL, name);
+		}
+	}
+
+	/* the state machine */
+	u.p = prog;
+	uint64_t addr = 0, file = 1;
+	int64_t line = 1;
+#define LS_FILE (file < nfiles ? files[file] : "??")
+	while (u.p < u.end) {
+		unsigned int op = *u.p++;
+		if (op >= opcode_base) {
+			unsigned int adj = op - opcode_base;
+			addr += (uint64_t)(adj / line_range) * min_len;
+			line += line_base + (int)(adj % line_range);
+			emit(m, addr, LS_FILE, (unsigned)line, 0);
+			continue;
+		}
+		switch (op) {
+		case 0: /* extended */
+		{
+			uint64_t n = uleb(&u);
+			if (!n || n > (uint64_t)(u.end - u.p)) {
+				u.p = u.end;
+				break;
+			}
+			const unsigned char* next = u.p + n;
+			unsigned int sub = *u.p++;
+			if (sub == 1) { /* end_sequence */
+				emit(m, addr, LS_FILE, (unsigned)line, 1);
+				addr = 0;
+				file = 1;
+				line = 1;
+			} else if (sub == 2) /* set_address */
+				addr = fixed(&u, addr_size);
+			u.p = next;
+			break;
+		}
+		case 1: /* copy */
+			emit(m, addr, LS_FILE, (unsigned)line, 0);
+			break;
+		case 2: /* advance_pc */
+			addr += uleb(&u) * min_len;
+			break;
+		case 3: /* advance_line */
+			line += sleb(&u);
+			break;
+		case 4: /* set_file */
+			file = uleb(&u);
+			break;
+		case 8: /* const_add_pc */
+			addr += (uint64_t)((255 - opcode_base) / line_range) * min_len;
+			break;
+		case 9: /* fixed_advance_pc */
+			addr += fixed(&u, 2);
+			break;
+		default:
+			for (unsigned int i = 0; i < std_len[op]; i++)
+				uleb(&u);
+			break;
+		}
+	}
+#undef LS_FILE
+	free((void*)files);
+}
+
+static int row_cmp(const void* a, const void* b)
+{
+	const Row* x = (const Row*)a;
+	const Row* y = (const Row*)b;
+	if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+	return y->end - x->end; /* an end row yields to code at the same addr */
+}
+
+static void load_lines(Module* m)
+{
+	const Elf64_Shdr* dl = section(m, ".debug_line");
+	if (!dl) return;
+	const Elf64_Shdr* ls = section(m, ".debug_line_str");
+	const Elf64_Shdr* ds = section(m, ".debug_str");
+	if (dl->sh_flags & SHF_COMPRESSED) return;
+	Strs line_str = { NULL, 0 }, str = { NULL, 0 };
+	if (ls && !(ls->sh_flags & SHF_COMPRESSED)) {
+		line_str.data = (const char*)m->img + ls->sh_offset;
+		line_str.size = ls->sh_size;
+	}
+	if (ds && !(ds->sh_flags & SHF_COMPRESSED)) {
+		str.data = (const char*)m->img + ds->sh_offset;
+		str.size = ds->sh_size;
+	}
+	Cur c = { m->img + dl->sh_offset, m->img + dl->sh_offset + dl->sh_size };
+	while (c.p < c.end)
+		line_unit(m, &c, &line_str, &str);
+	qsort(m->rows, m->nrows, sizeof(Row), row_cmp);
+}
+
+static void load_module(Module* m)
+{
+	m->loaded = 1;
+	int fd = open(m->path, O_RDONLY);
+	if (fd < 0) return;
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+		close(fd);
+		return;
+	}
+	void* img = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (img == MAP_FAILED) return;
+	const Elf64_Ehdr* eh = (const Elf64_Ehdr*)img;
+	if (memcmp(eh->e_ident, ELFMAG, SELFMAG) ||
+		eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+		eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+		eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) >
+		  (uint64_t)st.st_size) {
+		munmap(img, (size_t)st.st_size);
+		return;
+	}
+	m->img = (const unsigned char*)img;
+	m->img_sz = (size_t)st.st_size;
+	m->ph = (const Elf64_Phdr*)(m->img + eh->e_phoff);
+	m->nph = eh->e_phnum;
+	load_syms(m, ".symtab", ".strtab");
+	if (!m->nsyms) load_syms(m, ".dynsym", ".dynstr");
+	qsort(m->syms, m->nsyms, sizeof(Sym), sym_cmp);
+	load_lines(m);
+}
+
+/* file offset -> link-time address through the PT_LOAD headers */
+static int to_vaddr(const Module* m, uint64_t off, uint64_t* va)
+{
+	for (size_t i = 0; i < m->nph; i++) {
+		const Elf64_Phdr* p = &m->ph[i];
+		if (p->p_type != PT_LOAD) continue;
+		if (off >= p->p_offset && off < p->p_offset + p->p_filesz) {
+			*va = off - p->p_offset + p->p_vaddr;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void resolve(Addr* a)
+{
+	for (size_t i = 0; i < nmaps; i++) {
+		const Map* mp = &maps[i];
+		if (a->addr < mp->start || a->addr >= mp->end) continue;
+		Module* m = &mods[mp->mod];
+		if (!m->loaded) load_module(m);
+		uint64_t va;
+		if (!m->img || !to_vaddr(m, a->addr - mp->start + mp->off, &va)) return;
+		/* return addresses point past the call */
+		uint64_t pc = va ? va - 1 : va;
+		size_t lo = 0, hi = m->nsyms;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (m->syms[mid].addr <= pc)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo) a->func = m->syms[lo - 1].name;
+		lo = 0;
+		hi = m->nrows;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (m->rows[mid].addr <= pc)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo && !m->rows[lo - 1].end) {
+			a->file = m->rows[lo - 1].file;
+			a->line = m->rows[lo - 1].line;
+		}
+		return;
+	}
+}
+
+/* --- report -------------------------------------------------------------- */
+
+static size_t module_for(const char* path)
+{
+	for (size_t i = 0; i < nmods; i++)
+		if (!strcmp(mods[i].path, path)) return i;
+	mods = (Module*)xrealloc(mods, (nmods + 1) * sizeof(Module));
+	memset(&mods[nmods], 0, sizeof(Module));
+	mods[nmods].path = strdup(path);
+	return nmods++;
+}
+
+/* "[LEAKED] map: start-end perms offset dev inode path" */
+static void parse_map(const char* line)
+{
+	const char* s = strstr(line, "map: ");
+	unsigned long long start, end, off;
+	int at = 0;
+	if (!s) return;
+	const char* fmt = "%llx-%llx %*s %llx %*s %*s %n";
+	if (sscanf(s + 5, fmt, &start, &end, &off, &at) < 3 || !at) return;
+	char path[4096];
+	if (sscanf(s + 5 + at, "%4095[^\n]", path) != 1) return;
+	maps = (Map*)xrealloc(maps, (nmaps + 1) * sizeof(Map));
+	maps[nmaps].start = start;
+	maps[nmaps].end = end;
+	maps[nmaps].off = off;
+	maps[nmaps].mod = module_for(path);
+	nmaps++;
+}
+
+static int addr_cmp(const void* a, const void* b)
+{
+	uint64_t x = ((const Addr*)a)->addr, y = ((const Addr*)b)->addr;
+	return x < y ? -1 : x > y;
+}
+
+static int is_hex(int c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+		   (c >= 'A' && c <= 'F');
+}
+
+/* calls fn for every 0x... token of the line */
+static void each_addr(const char* line,
+					  void (*fn)(const char* at, size_t len, uint64_t v, void*),
+					  void* arg)
+{
+	for (const char* p = line; (p = strstr(p, "0x")); ) {
+		const char* e = p + 2;
+		while (is_hex(*e))
+			e++;
+		if (e > p + 2) fn(p, (size_t)(e - p), strtoull(p, NULL, 16), arg);
+		p = e;
+	}
+}
+
+typedef struct
+{
+	Addr* v;
+	size_t n, cap;
+} Addrs;
+
+static void collect(const char* at, size_t len, uint64_t v, void* arg)
+{
+	Addrs* a = (Addrs*)arg;
+	(void)at;
+	(void)len;
+	if (a->n == a->cap) {
+		a->cap = a->cap ? a->cap * 2 : 1024;
+		a->v = (Addr*)xrealloc(a->v, a->cap * sizeof(Addr));
+	}
+	a->v[a->n].addr = v;
+	a->v[a->n].func = NULL;
+	a->v[a->n].file = NULL;
+	a->v[a->n].line = 0;
+	a->n++;
+}
+
+static const Addrs* lookup_set;
+static int fold; /* -f */
+
+static void annotate(const char* at, size_t len, uint64_t v, void* arg)
+{
+	const char** cursor = (const char**)arg;
+	Addr key;
+	key.addr = v;
+	const Addr* a = (const Addr*)bsearch(
+	  &key, lookup_set->v, lookup_set->n, sizeof(Addr), addr_cmp);
+	if (fold) {
+		fwrite(*cursor, 1, (size_t)(at - *cursor), stdout);
+		*cursor = at + len;
+		if (a && a->func)
+			fputs(a->func, stdout);
+		else
+			fwrite(at, 1, len, stdout);
+		return;
+	}
+	fwrite(*cursor, 1, (size_t)(at + len - *cursor), stdout);
+	*cursor = at + len;
+	if (!a || (!a->func && !a->file)) return;
+	printf(" in %s", a->func ? a->func : "??");
+	if (a->file) printf(" %s:%u", a->file, a->line);
+}
+
+int main(int argc, char** argv)
+{
+	FILE* in = stdin;
+	int arg = 1;
+	if (arg < argc && !strcmp(argv[arg], "-f")) {
+		fold = 1;
+		arg++;
+	}
+	if (arg < argc && !(in = fopen(argv[arg], "r"))) {
+		perror(argv[arg]);
+		return 1;
+	}
+
+	/* the whole report first: maps may come after the addresses */
+	char** lines = NULL;
+	size_t nlines = 0, cap = 0;
+	char* buf = NULL;
+	size_t bufcap = 0;
+	while (getline(&buf, &bufcap, in) > 0) {
+		if (nlines == cap) {
+			cap = cap ? cap * 2 : 1024;
+			lines = (char**)xrealloc(lines, cap * sizeof(char*));
+		}
+		lines[nlines++] = strdup(buf);
+		if (strstr(buf, " map: ")) parse_map(buf);
+	}
+	free(buf);
+
+	/* each distinct address is resolved once, in address order so a
+	 * module's tables stay hot */
+	Addrs all = { NULL, 0, 0 };
+	for (size_t i = 0; i < nlines; i++)
+		if (!strstr(lines[i], " map: ")) each_addr(lines[i], collect, &all);
+	if (all.n) qsort(all.v, all.n, sizeof(Addr), addr_cmp);
+	size_t u = 0;
+	for (size_t i = 0; i < all.n; i++)
+		if (!u || all.v[u - 1].addr != all.v[i].addr) all.v[u++] = all.v[i];
+	all.n = u;
+	for (size_t i = 0; i < all.n; i++)
+		resolve(&all.v[i]);
+
+	lookup_set = &all;
+	for (size_t i = 0; i < nlines; i++) {
+		const char* cursor = lines[i];
+		if (!strstr(lines[i], " map: ")) {
+			size_t len = strlen(lines[i]);
+			int nl = len && lines[i][len - 1] == '\n';
+			if (nl) lines[i][len - 1] = 0;
+			each_addr(lines[i], annotate, (void*)&cursor);
+			fputs(cursor, stdout);
+			if (nl) fputc('\n', stdout);
+		} else if (!fold)
+			fputs(lines[i], stdout);
+		free(lines[i]);
+	}
+	free(lines);
+	free(all.v);
+	return 0;
+}
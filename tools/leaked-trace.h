@@ -0,0 +1,292 @@
+/*
+ * reader for the binary traces leaked.h writes with LEAKED_TRACE, shared
+ * by the tools in this directory. the layout is described next to the
+ * writer in leaked.h. the file is mapped, chunks are walked in place and
+ * events are decoded one at a time, so nothing here allocates
+ */
+
+#ifndef LEAKED_TRACE_READER_H
+#define LEAKED_TRACE_READER_H 1
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LT_API static __attribute__((unused))
+
+#define LT_MAGIC "LEAKTRC2"
+#define LT_MALLOC 0
+#define LT_FREE 1
+#define LT_REALLOC 2
+
+typedef struct
+{
+	const unsigned char* data;
+	size_t size;
+} LtFile;
+
+typedef struct
+{
+	char type;				/* 'S' site, 'E' events, 'C' checkpoint, 'I' */
+	const unsigned char* p; /* payload */
+	size_t len;
+	size_t off; /* of the chunk header in the file */
+} LtChunk;
+
+typedef struct
+{
+	uint64_t t;	  /* ns, when ptr (old for a realloc) changed hands */
+	uint64_t gap; /* realloc: ns from releasing old to owning ptr */
+	uint64_t ptr;
+	uint64_t old;
+	uint64_t size; /* 0 for a free, the block's is in its malloc */
+	uint32_t tid;
+	uint32_t site;
+	int op;
+} LtEvent;
+
+typedef struct
+{
+	const unsigned char* p;
+	const unsigned char* end;
+	uint32_t tid;
+	uint32_t left; /* events not decoded yet */
+	uint64_t t0;
+	uint64_t span; /* t0 to the last change to the heap, realloc gaps too */
+	uint64_t last;
+	uint64_t prev;
+} LtEvents;
+
+/* a block live at a checkpoint */
+typedef struct
+{
+	uint64_t ptr;
+	uint64_t size;
+	uint32_t site;
+} LtBlock;
+
+typedef struct
+{
+	const unsigned char* p;
+	const unsigned char* end;
+	uint64_t t; /* holds every change stamped before t */
+	uint64_t left;
+	uint64_t prev;
+} LtBlocks;
+
+/* an entry of the 'I' index */
+typedef struct
+{
+	char type; /* 'S', 'E' or 'C' */
+	size_t off;
+	uint64_t t0; /* 'E' t0, 'C' t */
+	uint64_t span;
+} LtIndexEntry;
+
+typedef struct
+{
+	const unsigned char* p;
+	const unsigned char* end;
+	uint64_t left;
+} LtIndex;
+
+typedef struct
+{
+	uint32_t id;
+	uint64_t pc;	  /* return address, LEAKED_RETADDR traces */
+	uint32_t line;	  /* file:line traces */
+	const char* name; /* not terminated */
+	size_t name_len;
+} LtSite;
+
+/* LEB128, sets *p past the end on truncated input */
+static uint64_t lt_varint(const unsigned char** p, const unsigned char* end)
+{
+	uint64_t v = 0;
+	unsigned int shift = 0;
+	while (*p < end) {
+		unsigned char b = *(*p)++;
+		if (shift < 64) v |= (uint64_t)(b & 0x7f) << shift;
+		shift += 7;
+		if (!(b & 0x80)) return v;
+	}
+	*p = end + 1;
+	return 0;
+}
+
+static uint64_t lt_ptr(const unsigned char** p,
+					   const unsigned char* end,
+					   uint64_t base,
+					   int raw)
+{
+	uint64_t v = lt_varint(p, end);
+	if (raw) return v;
+	int64_t d = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	return (uint64_t)((int64_t)(base >> 4) + d) << 4;
+}
+
+/* map a trace, 0 on success */
+LT_API int lt_open(LtFile* f, const char* path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	f->data = NULL;
+	f->size = 0;
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	f->size = (size_t)st.st_size;
+	void* m = f->size < 8 ? MAP_FAILED
+						  : mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED || memcmp(m, LT_MAGIC, 8)) {
+		fprintf(stderr, "%s: not a leaked.h trace\n", path);
+		if (m != MAP_FAILED) munmap(m, f->size);
+		return -1;
+	}
+	posix_madvise(m, f->size, POSIX_MADV_SEQUENTIAL);
+	f->data = (const unsigned char*)m;
+	return 0;
+}
+
+LT_API void lt_close(LtFile* f)
+{
+	if (f->data) munmap((void*)f->data, f->size);
+	f->data = NULL;
+}
+
+/* the chunk at *off, advancing *off past it. 0 at the end of the file or
+ * on a truncated chunk (a crashed writer) */
+LT_API int lt_chunk(const LtFile* f, size_t* off, LtChunk* c)
+{
+	if (*off < 8) *off = 8;
+	if (*off > f->size || f->size - *off < 5) return 0;
+	const unsigned char* h = f->data + *off;
+	size_t len = (size_t)h[1] | (size_t)h[2] << 8 | (size_t)h[3] << 16 |
+				 (size_t)h[4] << 24;
+	if (f->size - *off - 5 < len) return 0;
+	c->type = (char)h[0];
+	c->p = h + 5;
+	c->len = len;
+	c->off = *off;
+	*off += 5 + len;
+	return 1;
+}
+
+/* decode an 'S' chunk */
+LT_API int lt_site(const LtChunk* c, LtSite* s)
+{
+	const unsigned char* p = c->p;
+	const unsigned char* end = c->p + c->len;
+	s->id = (uint32_t)lt_varint(&p, end);
+	s->pc = lt_varint(&p, end);
+	s->line = (uint32_t)lt_varint(&p, end);
+	s->name_len = (size_t)lt_varint(&p, end);
+	s->name = (const char*)p;
+	return p <= end && s->name_len <= (size_t)(end - p);
+}
+
+/* start decoding an 'E' chunk */
+LT_API int lt_events(const LtChunk* c, LtEvents* it)
+{
+	const unsigned char* p = c->p;
+	const unsigned char* end = c->p + c->len;
+	it->tid = (uint32_t)lt_varint(&p, end);
+	it->t0 = it->last = lt_varint(&p, end);
+	it->span = lt_varint(&p, end);
+	it->left = (uint32_t)lt_varint(&p, end);
+	it->prev = 0;
+	it->p = p;
+	it->end = end;
+	return p <= end;
+}
+
+/* the next event of the chunk, 0 when done */
+LT_API int lt_event(LtEvents* it, LtEvent* e)
+{
+	if (!it->left || it->p >= it->end) return 0;
+	uint64_t h = lt_varint(&it->p, it->end);
+	int raw = (int)(h >> 2) & 1;
+	it->last += h >> 3;
+	e->op = (int)(h & 3);
+	e->t = it->last;
+	e->tid = it->tid;
+	e->ptr = lt_ptr(&it->p, it->end, it->prev, raw);
+	e->size = e->op == LT_FREE ? 0 : lt_varint(&it->p, it->end);
+	e->site = (uint32_t)lt_varint(&it->p, it->end);
+	e->old = 0;
+	e->gap = 0;
+	if (e->op == LT_REALLOC) {
+		e->old = lt_ptr(&it->p, it->end, e->ptr, raw);
+		e->gap = lt_varint(&it->p, it->end);
+	}
+	it->prev = e->ptr;
+	it->left--;
+	return it->p <= it->end;
+}
+
+/* start decoding a 'C' chunk */
+LT_API int lt_blocks(const LtChunk* c, LtBlocks* it)
+{
+	const unsigned char* p = c->p;
+	const unsigned char* end = c->p + c->len;
+	it->t = lt_varint(&p, end);
+	it->left = lt_varint(&p, end);
+	it->prev = 0;
+	it->p = p;
+	it->end = end;
+	return p <= end;
+}
+
+/* the next block of the checkpoint, 0 when done */
+LT_API int lt_block(LtBlocks* it, LtBlock* b)
+{
+	if (!it->left || it->p >= it->end) return 0;
+	uint64_t h = lt_varint(&it->p, it->end);
+	b->size = h >> 1;
+	b->ptr = lt_ptr(&it->p, it->end, it->prev, (int)(h & 1));
+	b->site = (uint32_t)lt_varint(&it->p, it->end);
+	it->prev = b->ptr;
+	it->left--;
+	return it->p <= it->end;
+}
+
+/* find the 'I' chunk through the offset the file ends with. 0 when there
+ * is none or chunks were written after it (threads outliving exit) */
+LT_API int lt_index(const LtFile* f, LtIndex* it)
+{
+	LtChunk c;
+	if (f->size < 8 + 5 + 8) return 0;
+	const unsigned char* t = f->data + f->size - 8;
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++)
+		v |= (uint64_t)t[i] << (8 * i);
+	size_t off = (size_t)v;
+	if (v > f->size || !lt_chunk(f, &off, &c) || c.type != 'I' ||
+		off != f->size || c.len < 8)
+		return 0;
+	it->p = c.p;
+	it->end = c.p + c.len - 8;
+	it->left = lt_varint(&it->p, it->end);
+	return it->p <= it->end;
+}
+
+/* the next index entry, 0 when done */
+LT_API int lt_index_next(LtIndex* it, LtIndexEntry* e)
+{
+	if (!it->left || it->p >= it->end) return 0;
+	e->type = (char)*it->p++;
+	e->off = (size_t)lt_varint(&it->p, it->end);
+	e->t0 = lt_varint(&it->p, it->end);
+	e->span = lt_varint(&it->p, it->end);
+	it->left--;
+	return it->p <= it->end;
+}
+
+#endif /* LEAKED_TRACE_READER_H */